@@ -0,0 +1,153 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+/* Command completion benchmark.
+ *
+ * Fills $PATH with directories holding a growing number of executables and
+ * times a Tab on the first word: the first one, which reads the directories
+ * into the trie, the following ones, which only check the directories'
+ * modification times, and for comparison a completion that reads every
+ * directory with readdir() and checks every entry with stat() and access()
+ * on each Tab.
+ *
+ * Usage: bench/complete_bench [max-entries] */
+
+#include "path_trie.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DIRS 10
+#define ROUNDS 50
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void count_name(const char *name, void *arg) {
+    (void)name;
+    (*(size_t *)arg)++;
+}
+
+// What a completion without a cache does on every Tab
+static size_t complete_readdir(const char *prefix) {
+    char *path = strdup(getenv("PATH"));
+    size_t len = strlen(prefix), found = 0;
+
+    for (char *dir = strtok(path, ":"); dir != NULL; dir = strtok(NULL, ":")) {
+        DIR *d = opendir(dir);
+        struct dirent *e;
+
+        if (d == NULL) {
+            continue;
+        }
+        while ((e = readdir(d)) != NULL) {
+            char file[4096];
+            struct stat st;
+
+            if (strncmp(e->d_name, prefix, len) != 0) {
+                continue;
+            }
+            snprintf(file, sizeof(file), "%s/%s", dir, e->d_name);
+            if (stat(file, &st) == 0 && S_ISREG(st.st_mode) && access(file, X_OK) == 0) {
+                found++;
+            }
+        }
+        closedir(d);
+    }
+    free(path);
+    return found;
+}
+
+// Add executables to the directories until there are 'total' of them
+static void fill(char dirs[DIRS][64], size_t *made, size_t total) {
+    for (; *made < total; (*made)++) {
+        char file[128];
+        int fd;
+
+        snprintf(file, sizeof(file), "%s/%c%c-tool-%zu", dirs[*made % DIRS],
+                 'a' + (int)(*made % 26), 'a' + (int)(*made / 26 % 26), *made);
+        fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+        if (fd == -1) {
+            perror("open");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t max = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000;
+    char root[] = "/tmp/nsh_complete_bench_XXXXXX";
+    char dirs[DIRS][64];
+    char path[DIRS * 64];
+    size_t made = 0;
+
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    path[0] = '\0';
+    for (int i = 0; i < DIRS; i++) {
+        snprintf(dirs[i], sizeof(dirs[i]), "%s/bin%d", root, i);
+        if (mkdir(dirs[i], 0755) == -1) {
+            perror("mkdir");
+            return EXIT_FAILURE;
+        }
+        strcat(path, i ? ":" : "");
+        strcat(path, dirs[i]);
+    }
+    setenv("PATH", path, 1);
+
+    printf("%-10s %8s %16s %16s %16s\n", "entries", "matches", "first Tab (us)", "trie Tab (us)",
+           "readdir Tab (us)");
+    for (size_t total = 1250; total <= max; total *= 4) {
+        size_t found = 0;
+        double start, first_us, trie_us, readdir_us;
+
+        fill(dirs, &made, total);
+        path_trie_reset();
+        start = now_us();
+        path_trie_complete(path, "b", count_name, &found);
+        first_us = now_us() - start;
+
+        start = now_us();
+        for (int i = 0; i < ROUNDS; i++) {
+            path_trie_complete(path, "b", count_name, &found);
+        }
+        trie_us = (now_us() - start) / ROUNDS;
+
+        start = now_us();
+        for (int i = 0; i < ROUNDS; i++) {
+            found = complete_readdir("b");
+        }
+        readdir_us = (now_us() - start) / ROUNDS;
+
+        printf("%-10zu %8zu %16.1f %16.1f %16.1f\n", total, found, first_us, trie_us, readdir_us);
+        fflush(stdout);
+    }
+
+    for (size_t i = 0; i < made; i++) {
+        char file[128];
+        snprintf(file, sizeof(file), "%s/%c%c-tool-%zu", dirs[i % DIRS], 'a' + (int)(i % 26),
+                 'a' + (int)(i / 26 % 26), i);
+        unlink(file);
+    }
+    for (int i = 0; i < DIRS; i++) {
+        rmdir(dirs[i]);
+    }
+    rmdir(root);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+/* History startup benchmark.
+ *
+ * Measures how long it takes to load history files of growing size before
+ * the first prompt can be shown: once with linenoiseHistoryLoad(), which only
+ * reads and indexes the tail of the file, and once with the line by line
+ * fgets() + linenoiseHistoryAdd() loop it replaced. Each load runs in a child
+ * process so it starts from an empty history.
+ *
+ * Usage: bench/history_bench [max-size-MB] */
+
+#include "linenoise.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HISTORY_SIZE 10000 /* nsh's default NSH_HISTSIZE */
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void load_tail(const char *path) {
+    linenoiseHistoryLoad(path);
+}
+
+static void load_fgets(const char *path) {
+    char buf[4096];
+    FILE *fp = fopen(path, "r");
+
+    if (fp == NULL) {
+        return;
+    }
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        buf[strcspn(buf, "\r\n")] = '\0';
+        linenoiseHistoryAdd(buf);
+    }
+    fclose(fp);
+}
+
+// Time one load in a fresh child process
+static double run(void (*load)(const char *), const char *path) {
+    int fds[2];
+    double us = -1;
+    pid_t pid;
+
+    if (pipe(fds) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    pid = fork();
+    if (pid == 0) {
+        double start;
+
+        close(fds[0]);
+        linenoiseHistorySetMaxLen(HISTORY_SIZE);
+        start = now_us();
+        load(path);
+        us = now_us() - start;
+        if (write(fds[1], &us, sizeof(us)) != sizeof(us)) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    if (read(fds[0], &us, sizeof(us)) != sizeof(us)) {
+        us = -1;
+    }
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    return us;
+}
+
+// Grow the history file to 'size' bytes of shell-like commands
+static void fill(FILE *fp, size_t *written, size_t size) {
+    static unsigned long n = 0;
+
+    while (*written < size) {
+        int len = fprintf(fp, "git commit -m \"change number %lu\" --author=nsh\n", n++);
+        if (len < 0) {
+            perror("fprintf");
+            exit(EXIT_FAILURE);
+        }
+        *written += len;
+    }
+    fflush(fp);
+}
+
+int main(int argc, char **argv) {
+    size_t max_mb = (argc > 1) ? strtoul(argv[1], NULL, 10) : 256;
+    char path[] = "/tmp/nsh_history_bench_XXXXXX";
+    size_t written = 0;
+    int fd = mkstemp(path);
+    FILE *fp;
+
+    if (fd == -1 || (fp = fdopen(fd, "w")) == NULL) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-10s %14s %14s\n", "file(MB)", "tail (us)", "fgets (us)");
+    for (size_t mb = 1; mb <= max_mb; mb *= 4) {
+        fill(fp, &written, mb << 20);
+        double tail_us = run(load_tail, path);
+        double fgets_us = run(load_fgets, path);
+        printf("%-10zu %14.1f %14.1f\n", mb, tail_us, fgets_us);
+        fflush(stdout);
+    }
+    fclose(fp);
+    unlink(path);
+    return EXIT_SUCCESS;
+}
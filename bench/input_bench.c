@@ -0,0 +1,124 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+/* Batch input benchmark.
+ *
+ * Measures how long it takes to split a generated command stream into
+ * lines, the way nsh reads commands piped or redirected into it: once with
+ * the batch reader, which maps a file or reads a pipe in large blocks, and
+ * once with linenoise(), whose non-tty path reads the stream one fgetc() at
+ * a time. Each run happens in a child process with the stream as its stdin.
+ *
+ * Usage: bench/input_bench [lines] */
+
+#include "input.h"
+#include "linenoise.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static size_t read_batch(void) {
+    struct batch_input in;
+    size_t bytes = 0;
+    char *line;
+
+    if (batch_open(&in, STDIN_FILENO) == -1) {
+        return 0;
+    }
+    while ((line = batch_next(&in)) != NULL) {
+        bytes += strlen(line);
+    }
+    batch_close(&in);
+    return bytes;
+}
+
+static size_t read_linenoise(void) {
+    size_t bytes = 0;
+    char *line;
+
+    while ((line = linenoise("")) != NULL) {
+        bytes += strlen(line);
+        linenoiseFree(line);
+    }
+    return bytes;
+}
+
+// Time one read of 'path' in a fresh child, through a pipe if 'piped'
+static double run(size_t (*reader)(void), const char *path, int piped) {
+    int fds[2];
+    double us = -1;
+    pid_t pid;
+
+    if (pipe(fds) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    pid = fork();
+    if (pid == 0) {
+        double start;
+
+        close(fds[0]);
+        if (piped) {
+            // stdin is fed by a cat of the file
+            FILE *cat = popen("cat -- \"$NSH_BENCH_FILE\"", "r");
+            if (cat == NULL) {
+                _exit(EXIT_FAILURE);
+            }
+            dup2(fileno(cat), STDIN_FILENO);
+        } else if (freopen(path, "r", stdin) == NULL) {
+            _exit(EXIT_FAILURE);
+        }
+        start = now_us();
+        reader();
+        us = now_us() - start;
+        if (write(fds[1], &us, sizeof(us)) != sizeof(us)) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    if (read(fds[0], &us, sizeof(us)) != sizeof(us)) {
+        us = -1;
+    }
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    return us;
+}
+
+int main(int argc, char **argv) {
+    size_t lines = (argc > 1) ? strtoul(argv[1], NULL, 10) : 100000;
+    char path[] = "/tmp/nsh_input_bench_XXXXXX";
+    int fd = mkstemp(path);
+    FILE *fp;
+
+    if (fd == -1 || (fp = fdopen(fd, "w")) == NULL) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < lines; i++) {
+        fprintf(fp, "gzip -9 -c build/output/part-%06zu.log > archive/part-%06zu.log.gz\n", i, i);
+    }
+    fclose(fp);
+    setenv("NSH_BENCH_FILE", path, 1);
+
+    printf("%zu lines\n", lines);
+    printf("%-8s %14s %14s\n", "stdin", "batch (us)", "fgetc (us)");
+    printf("%-8s %14.1f %14.1f\n", "file", run(read_batch, path, 0), run(read_linenoise, path, 0));
+    printf("%-8s %14.1f %14.1f\n", "pipe", run(read_batch, path, 1), run(read_linenoise, path, 1));
+    unlink(path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,483 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+/* Line editing benchmark.
+ *
+ * Types keys into linenoise through a pseudo terminal, the way a user at
+ * the prompt would, and reports for each kind of editing how many heap
+ * allocations and how many bytes of terminal output a keystroke costs.
+ * Allocations are counted by wrapping malloc() and friends, so any of them
+ * on the keystroke path shows up, not only the ones linenoise knows about.
+ *
+ * It then checks that updating the line with only what changed leaves the
+ * screen as a full redraw does: random keys are typed into a narrow line,
+ * the output is applied to a model of the terminal, and after each key the
+ * screen must not change when Ctrl-L redraws the line in full. The exit
+ * status is 1 if it does.
+ *
+ * Usage: bench/render_bench [columns] */
+
+#define _GNU_SOURCE
+
+#include "linenoise.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static int counting = 0;
+static unsigned long allocs = 0;
+
+void *malloc(size_t size) {
+    allocs += counting;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    allocs += counting;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    allocs += counting;
+    return __libc_realloc(ptr, size);
+}
+
+#define TEXT "git commit -m 'fix the parser' && make check; "
+#define CJK_TEXT "修复解析器并运行测试"
+
+static int master = -1;
+static int slave = -1;
+static unsigned long completion_calls = 0;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Read what linenoise wrote to the terminal into 'out', returning its size
+static size_t read_output(char *out, size_t size) {
+    size_t total = 0;
+    ssize_t n;
+
+    while (total < size - 1 && (n = read(master, out + total, size - 1 - total)) > 0) {
+        total += n;
+    }
+    out[total] = '\0';
+    return total;
+}
+
+// Read what linenoise wrote to the terminal, returning its size
+static size_t drain(void) {
+    char buf[65536];
+    size_t total = 0;
+    ssize_t n;
+
+    while ((n = read(master, buf, sizeof(buf))) > 0) {
+        total += n;
+    }
+    return total;
+}
+
+struct result {
+    unsigned long keys;
+    unsigned long allocs;
+    size_t bytes;
+    double us;
+};
+
+// 200 candidates, such as the files of a directory
+static void complete(const char *line, linenoiseCompletions *lc) {
+    char candidate[128];
+
+    completion_calls++;
+    for (int i = 0; i < 200; i++) {
+        snprintf(candidate, sizeof(candidate), "%.64sfile-%03d.c", line, i);
+        linenoiseAddCompletion(lc, candidate);
+    }
+}
+
+// Feed 'count' keys of 'klen' bytes each, going round the ones in 'keys'
+static void type(struct linenoiseState *l, const char *keys, size_t klen, int count,
+                 struct result *r) {
+    size_t total = strlen(keys);
+
+    for (int i = 0; i < count; i++) {
+        const char *key = keys + (i * klen) % total;
+        double start = now_us();
+
+        if (write(master, key, klen) != (ssize_t)klen) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        counting = 1;
+        linenoiseEditFeed(l);
+        counting = 0;
+        r->us += now_us() - start;
+        r->bytes += drain();
+        r->keys++;
+    }
+}
+
+// Queue 'count' keys of 'klen' bytes each before linenoise reads any, as
+// when typing ahead of a slow command, then let it handle them
+static void type_ahead(struct linenoiseState *l, const char *keys, size_t klen, int count,
+                       struct result *r) {
+    size_t total = strlen(keys);
+    double start;
+
+    for (int i = 0; i < count; i++) {
+        if (write(master, keys + (i * klen) % total, klen) != (ssize_t)klen) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+    }
+    start = now_us();
+    counting = 1;
+    do {
+        linenoiseEditFeed(l);
+    } while (linenoiseEditPending());
+    counting = 0;
+    r->us += now_us() - start;
+    r->bytes += drain();
+    r->keys += count;
+}
+
+// Paste 'len' bytes of 'text' in one go, between the marks of bracketed
+// paste. The terminal takes a few KB of input at a time, so a child writes
+// the paste while linenoise reads it.
+static void paste(struct linenoiseState *l, const char *text, size_t len, struct result *r) {
+    double start = now_us();
+    pid_t pid = fork();
+
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        struct pollfd pfd = {master, POLLOUT, 0};
+        char *data = malloc(len + 12);
+        size_t total = len + 12, done = 0;
+
+        memcpy(data, "\033[200~", 6);
+        memcpy(data + 6, text, len);
+        memcpy(data + 6 + len, "\033[201~", 6);
+        while (done < total) {
+            ssize_t n = write(master, data + done, total - done);
+            if (n > 0) {
+                done += n;
+            } else {
+                poll(&pfd, 1, -1);
+            }
+        }
+        _exit(EXIT_SUCCESS);
+    }
+    counting = 1;
+    linenoiseEditFeed(l);
+    counting = 0;
+    waitpid(pid, NULL, 0);
+    r->us += now_us() - start;
+    r->bytes += drain();
+    r->keys++;
+}
+
+static void report(const char *name, struct result *r) {
+    printf("%-28s %8lu %12.2f %12.1f %10.2f\n", name, r->keys, (double)allocs / r->keys,
+           (double)r->bytes / r->keys, r->us / r->keys);
+    allocs = 0;
+    memset(r, 0, sizeof(*r));
+}
+
+#define REPLAY_COLS 20
+#define REPLAY_KEYS 3000
+
+// One row of a terminal: what linenoise writes is applied to it
+struct screen {
+    char cells[REPLAY_COLS][8]; // UTF-8 of each cell, "" right of a wide one
+    int x;
+    int wrap; // The last column was written, the next character wraps
+};
+
+static void screen_clear(struct screen *t, int from) {
+    for (int i = from; i < REPLAY_COLS; i++) {
+        strcpy(t->cells[i], " ");
+    }
+}
+
+// Apply the output to the screen. Returns -1 on what the model does not
+// know, or on a line that wraps, which a single line edit must not do.
+static int screen_apply(struct screen *t, const char *s) {
+    while (*s) {
+        int n = 1, len, width;
+
+        if (*s == '\r') {
+            t->x = t->wrap = 0;
+            s++;
+            continue;
+        }
+        if (*s == '\b') {
+            t->x -= t->x > 0 && !t->wrap;
+            t->wrap = 0;
+            s++;
+            continue;
+        }
+        if (*s == '\033') {
+            char op;
+
+            // Bracketed paste on or off
+            if (strncmp(s, "\033[?2004", 7) == 0) {
+                s += 8;
+                continue;
+            }
+            if (s[1] != '[') {
+                return -1;
+            }
+            s += 2;
+            if (*s >= '0' && *s <= '9') {
+                n = strtol(s, (char **)&s, 10);
+            }
+            op = *s++;
+            switch (op) {
+            case 'C':
+                t->x = t->x + n < REPLAY_COLS ? t->x + n : REPLAY_COLS - 1;
+                break;
+            case 'D':
+                t->x = t->x - n > 0 ? t->x - n : 0;
+                break;
+            case 'H':
+                t->x = 0;
+                break;
+            case 'J':
+                screen_clear(t, 0);
+                break;
+            case 'K':
+                screen_clear(t, t->x);
+                break;
+            case '@':
+                memmove(t->cells[t->x + n], t->cells[t->x], (REPLAY_COLS - t->x - n) * 8);
+                for (int i = 0; i < n; i++) {
+                    strcpy(t->cells[t->x + i], " ");
+                }
+                break;
+            case 'P':
+                memmove(t->cells[t->x], t->cells[t->x + n], (REPLAY_COLS - t->x - n) * 8);
+                screen_clear(t, REPLAY_COLS - n);
+                break;
+            default:
+                return -1;
+            }
+            t->wrap = 0;
+            continue;
+        }
+        // The keys typed below only hold ASCII and CJK characters
+        len = (*s & 0x80) ? 3 : 1;
+        width = len == 3 ? 2 : 1;
+        if (t->wrap || t->x + width > REPLAY_COLS) {
+            return -1;
+        }
+        memcpy(t->cells[t->x], s, len);
+        t->cells[t->x][len] = '\0';
+        if (width == 2) {
+            t->cells[t->x + 1][0] = '\0';
+        }
+        t->x += width;
+        if (t->x == REPLAY_COLS) {
+            t->x--;
+            t->wrap = 1;
+        }
+        s += len;
+    }
+    return 0;
+}
+
+static int screen_equal(const struct screen *a, const struct screen *b) {
+    for (int i = 0; i < REPLAY_COLS; i++) {
+        if (strcmp(a->cells[i], b->cells[i]) != 0) {
+            return 0;
+        }
+    }
+    return a->x + a->wrap == b->x + b->wrap;
+}
+
+// Type a key (none for NULL) and apply the output. Returns -1 if the model
+// could not.
+static int replay_key(struct linenoiseState *l, struct screen *t, const char *key) {
+    static char out[65536];
+
+    if (key != NULL) {
+        if (write(master, key, strlen(key)) != (ssize_t)strlen(key)) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        linenoiseEditFeed(l);
+    }
+    read_output(out, sizeof(out));
+    return screen_apply(t, out);
+}
+
+// Type random keys into a REPLAY_COLS wide line: after each of them a full
+// redraw (Ctrl-L) must leave the screen as it was. Returns the number of
+// keys after which it did not.
+static int replay_check(void) {
+    static const char *keys[] = {"a", "b", "c", "x", " ", "中", "\033[D", "\033[D", "\033[C",
+                                 "\033[H", "\033[F", "\177", "\033[3~", "\027", "\013",
+                                 "\025"};
+    struct linenoiseState l;
+    struct screen t, before;
+    char buf[4096];
+    int saved = dup(STDOUT_FILENO), bad = 0;
+    char cols[8];
+
+    snprintf(cols, sizeof(cols), "%d", REPLAY_COLS);
+    setenv("LINENOISE_COLS", cols, 1);
+    // Ctrl-L clears the screen through the standard output
+    fflush(stdout);
+    dup2(slave, STDOUT_FILENO);
+    srand(1);
+    memset(&t, 0, sizeof(t));
+    screen_clear(&t, 0);
+    linenoiseEditStart(&l, slave, slave, buf, sizeof(buf), "> ");
+    for (int i = replay_key(&l, &t, NULL) == -1 ? (bad = 1, REPLAY_KEYS) : 0; i < REPLAY_KEYS; i++) {
+        if (replay_key(&l, &t, keys[rand() % (sizeof(keys) / sizeof(keys[0]))]) == -1) {
+            bad++;
+            break;
+        }
+        before = t;
+        if (replay_key(&l, &t, "\014") == -1) {
+            bad++;
+            break;
+        }
+        if (!screen_equal(&t, &before)) {
+            bad++;
+        }
+    }
+    linenoiseEditStop(&l);
+    drain();
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return bad;
+}
+
+int main(int argc, char **argv) {
+    struct linenoiseState l;
+    struct result r = {0};
+    static char buf[65536];
+    static char text[20480];
+    double calls_per_key;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1 ||
+        (slave = open(ptsname(master), O_RDWR | O_NOCTTY)) == -1) {
+        perror("pty");
+        return EXIT_FAILURE;
+    }
+    // A fixed width, without asking the terminal
+    setenv("LINENOISE_COLS", (argc > 1) ? argv[1] : "80", 1);
+    fcntl(master, F_SETFL, O_NONBLOCK);
+
+    printf("%-28s %8s %12s %12s %10s\n", "keystrokes", "keys", "allocs/key", "bytes/key", "us/key");
+
+    // linenoise only enters raw mode when its stdin is a terminal
+    dup2(slave, STDIN_FILENO);
+    if (linenoiseEditStart(&l, slave, slave, buf, sizeof(buf), "nsh $ ") == -1) {
+        perror("linenoiseEditStart");
+        return EXIT_FAILURE;
+    }
+    drain();
+    // Varied text, so that an edit does not leave the line looking the same
+    type(&l, TEXT, 1, 40, &r);
+    report("type at end (short line)", &r);
+
+    type(&l, "\033[D", 3, 20, &r);
+    report("cursor left", &r);
+
+    type(&l, TEXT, 1, 20, &r);
+    report("type in the middle", &r);
+
+    type(&l, "\033[F", 3, 1, &r);
+    allocs = 0;
+    memset(&r, 0, sizeof(r));
+    type(&l, TEXT, 1, 400, &r);
+    report("type at end (scrolling)", &r);
+
+    type(&l, "\177", 1, 200, &r);
+    report("backspace", &r);
+
+    // The same keys in the middle of the line, all typed ahead
+    type(&l, "\033[D", 3, 20, &r);
+    allocs = 0;
+    memset(&r, 0, sizeof(r));
+    type(&l, TEXT, 1, 40, &r);
+    report("type in the middle (long)", &r);
+    type_ahead(&l, TEXT, 1, 40, &r);
+    report("same, typed ahead", &r);
+
+    // Long lines, such as a pasted command: the line is filled first, then
+    // only the keys typed at its end are measured
+    type(&l, "\025", 1, 1, &r);
+    type(&l, TEXT, 1, 4000, &r);
+    allocs = 0;
+    memset(&r, 0, sizeof(r));
+    type(&l, TEXT, 1, 200, &r);
+    report("type at end (4K line)", &r);
+
+    type(&l, "\025", 1, 1, &r);
+    type(&l, CJK_TEXT, 3, 1500, &r);
+    allocs = 0;
+    memset(&r, 0, sizeof(r));
+    type(&l, CJK_TEXT, 3, 200, &r);
+    report("type at end (4K CJK line)", &r);
+
+    // A 20 KB paste: typed key by key when the terminal does not mark it,
+    // then inserted at once
+    for (size_t i = 0; i < sizeof(text); i++) {
+        text[i] = TEXT[i % strlen(TEXT)];
+    }
+    type(&l, "\025", 1, 1, &r);
+    allocs = 0;
+    memset(&r, 0, sizeof(r));
+    type(&l, text, 1, sizeof(text), &r);
+    r.keys = 1; // Reported for the whole paste
+    report("paste 20K (key by key)", &r);
+
+    type(&l, "\025", 1, 1, &r);
+    allocs = 0;
+    memset(&r, 0, sizeof(r));
+    paste(&l, text, sizeof(text), &r);
+    report("paste 20K (bracketed)", &r);
+
+    // Going round 200 completions with Tab
+    type(&l, "\025", 1, 1, &r);
+    type(&l, "cat ", 1, 4, &r);
+    linenoiseSetCompletionCallback(complete);
+    allocs = 0;
+    memset(&r, 0, sizeof(r));
+    type(&l, "\t", 1, 200, &r);
+    calls_per_key = (double)completion_calls / r.keys;
+    report("Tab through 200 completions", &r);
+    printf("%-28s %8s %12.2f\n", "", "calls/key", calls_per_key);
+    type(&l, "\033", 1, 1, &r);
+
+    linenoiseEditStop(&l);
+    drain();
+    linenoiseSetCompletionCallback(NULL);
+
+    int bad = replay_check();
+    printf("%d keys at %d columns: the screen differs from a full redraw after %d\n",
+           REPLAY_KEYS, REPLAY_COLS, bad);
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+/* Spawn latency benchmark.
+ *
+ * Measures how long it takes to start and reap /bin/true through
+ * launch_process(), once with fork() + exec() and once with posix_spawn(),
+ * while the shell holds a growing amount of heap (standing in for a large
+ * history) and a growing environment.
+ *
+ * Usage: bench/spawn_bench [iterations] */
+
+#include "launch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double run(enum launch_mode mode, int iterations) {
+    char *argv[] = {"true", NULL};
+    double start;
+
+    launch_set_mode(mode);
+    start = now_us();
+    for (int i = 0; i < iterations; i++) {
+        pid_t pid = launch_process("/bin/true", argv, NULL);
+        if (pid < 0) {
+            perror("launch_process");
+            exit(EXIT_FAILURE);
+        }
+        wait_process(pid);
+    }
+    return (now_us() - start) / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = (argc > 1) ? atoi(argv[1]) : 200;
+    const size_t heap_mb[] = {0, 64, 256, 1024};
+    const int env_vars[] = {0, 1000, 10000};
+    int env_set = 0;
+
+    printf("%-10s %-10s %14s %14s\n", "heap(MB)", "env vars", "fork (us)", "spawn (us)");
+    for (size_t e = 0; e < sizeof(env_vars) / sizeof(env_vars[0]); e++) {
+        // Grow the environment up to the requested number of variables
+        for (; env_set < env_vars[e]; env_set++) {
+            char name[32];
+            snprintf(name, sizeof(name), "NSH_BENCH_%d", env_set);
+            setenv(name, "some moderately long value to copy around", 1);
+        }
+
+        for (size_t h = 0; h < sizeof(heap_mb) / sizeof(heap_mb[0]); h++) {
+            size_t size = heap_mb[h] << 20;
+            char *heap = NULL;
+
+            // Touch every page so it is really mapped, like a loaded history
+            if (size) {
+                heap = malloc(size);
+                if (heap == NULL) {
+                    continue;
+                }
+                memset(heap, 1, size);
+            }
+
+            double fork_us = run(LAUNCH_FORK, iterations);
+            double spawn_us = run(LAUNCH_SPAWN, iterations);
+            printf("%-10zu %-10d %14.1f %14.1f\n", heap_mb[h], env_vars[e], fork_us, spawn_us);
+            free(heap);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,280 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#include "libs/builtins.h"
+#include "libs/history.h"
+#include "libs/jobs.h"
+#include "libs/parallel.h"
+#include "libs/path_hash.h"
+#include "libs/script.h"
+#include "libs/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static int builtin_bg(int argc, char **argv);
+static int builtin_cd(int argc, char **argv);
+static int builtin_clear(int argc, char **argv);
+static int builtin_echo(int argc, char **argv);
+static int builtin_exit(int argc, char **argv);
+static int builtin_export(int argc, char **argv);
+static int builtin_fg(int argc, char **argv);
+static int builtin_hash(int argc, char **argv);
+static int builtin_help(int argc, char **argv);
+static int builtin_jobs(int argc, char **argv);
+static int builtin_parallel(int argc, char **argv);
+static int builtin_pwd(int argc, char **argv);
+static int builtin_wait(int argc, char **argv);
+
+// Keep this table sorted by name: builtin_lookup() binary searches it
+static const struct builtin builtins[] = {
+    {"bg", builtin_bg, "bg [%job]", "Resume a stopped job in the background"},
+    {"cd", builtin_cd, "cd <directory>", "Change directory"},
+    {"clear", builtin_clear, "clear", "Clear the screen"},
+    {"echo", builtin_echo, "echo [text]", "Print text (supports $VAR expansion)"},
+    {"exit", builtin_exit, "exit [status]", "Exit the shell"},
+    {"export", builtin_export, "export [VAR[=value]]", "List, set or export environment variables"},
+    {"fg", builtin_fg, "fg [%job]", "Bring a job to the foreground"},
+    {"hash", builtin_hash, "hash [-r] [name...]", "Show, reset or add remembered command paths"},
+    {"help", builtin_help, "help", "Show this help message"},
+    {"jobs", builtin_jobs, "jobs", "List background and stopped jobs"},
+    {"parallel", builtin_parallel, "parallel [-j N] cmd...", "Run a command once per argument, N at a time"},
+    {"pwd", builtin_pwd, "pwd", "Print current working directory"},
+    {"wait", builtin_wait, "wait [%job|pid...]", "Wait for background jobs to finish"},
+};
+
+#define BUILTIN_COUNT (sizeof(builtins) / sizeof(builtins[0]))
+
+static int compare_builtin(const void *key, const void *elem) {
+    return strcmp((const char *)key, ((const struct builtin *)elem)->name);
+}
+
+const struct builtin *builtin_lookup(const char *name) {
+    return bsearch(name, builtins, BUILTIN_COUNT, sizeof(builtins[0]), compare_builtin);
+}
+
+const struct builtin *builtin_table(size_t *count) {
+    *count = BUILTIN_COUNT;
+    return builtins;
+}
+
+static int builtin_exit(int argc, char **argv) {
+    int status = (argc > 1) ? atoi(argv[1]) : last_exit_status();
+
+    // Inside a script, exit only ends the script
+    if (script_running()) {
+        script_exit(status);
+        return status;
+    }
+    // In a pipeline, it only ends the child running this stage
+    if (jobs_in_subshell()) {
+        fflush(stdout);
+        _exit(status);
+    }
+    history_shutdown();
+    exit(status);
+}
+
+static int builtin_pwd(int argc, char **argv) {
+    char cwd_buff[PATH_MAX];
+
+    (void)argc;
+    (void)argv;
+    if (getcwd(cwd_buff, sizeof(cwd_buff)) == NULL) {
+        perror(NSH_ERR "pwd" NSH_RESET);
+        return 1;
+    }
+    if (color_output()) {
+        printf(NSH_FG "%s\n" NSH_RESET, cwd_buff);
+    } else {
+        printf("%s\n", cwd_buff);
+    }
+    fflush(stdout);
+    return 0;
+}
+
+static int builtin_cd(int argc, char **argv) {
+    if (argc > 1) {
+        if (chdir(argv[1]) != 0) {
+            perror(NSH_ERR "cd" NSH_RESET);
+            return 1;
+        }
+        if (color_output()) {
+            printf(NSH_OK "Changed directory to: " NSH_FG "%s\n" NSH_RESET, argv[1]);
+            fflush(stdout);
+        }
+        return 0;
+    }
+
+    // cd with no arguments - go to home directory
+    const char *home = getenv("HOME");
+    if (home == NULL) {
+        fprintf(stderr, NSH_ERR "cd: HOME not set\n" NSH_RESET);
+        return 1;
+    }
+    if (chdir(home) != 0) {
+        perror(NSH_ERR "cd" NSH_RESET);
+        return 1;
+    }
+    if (color_output()) {
+        printf(NSH_OK "Changed directory to: " NSH_FG "%s\n" NSH_RESET, home);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+static int builtin_export(int argc, char **argv) {
+    char *var_name;
+    char *var_value;
+    char *equals_pos;
+    int status = 0;
+
+    if (argc == 1) {
+        // List all environment variables
+        int color = color_output();
+        for (char **env = environ; *env != NULL; env++) {
+            printf(color ? NSH_FG "declare -x %s\n" NSH_RESET : "declare -x %s\n", *env);
+        }
+        fflush(stdout);
+        return 0;
+    }
+
+    var_name = argv[1];
+    // Find '=' to separate variable name and value
+    equals_pos = strchr(var_name, '=');
+
+    if (equals_pos != NULL) {
+        // export VAR=value
+        *equals_pos = '\0'; // Temporarily null-terminate at '='
+        var_value = equals_pos + 1;
+
+        if (setenv(var_name, var_value, 1) != 0) {
+            perror(NSH_ERR "export" NSH_RESET);
+            status = 1;
+        } else {
+            if (strcmp(var_name, "PATH") == 0) {
+                path_hash_reset();
+                completion_reset();
+            }
+            if (color_output()) {
+                printf(NSH_OK "Exported: " NSH_ACCENT "%s" NSH_FG "=%s\n" NSH_RESET,
+                       var_name, var_value);
+                fflush(stdout);
+            }
+        }
+
+        *equals_pos = '='; // Restore '=' for proper cleanup
+    } else if (getenv(var_name) != NULL) {
+        // export VAR: the variable exists, it's already in the environment
+        if (color_output()) {
+            printf(NSH_OK "Exported: " NSH_ACCENT "%s\n" NSH_RESET, var_name);
+            fflush(stdout);
+        }
+    } else {
+        // Variable doesn't exist, set it to empty string
+        if (setenv(var_name, "", 1) != 0) {
+            perror(NSH_ERR "export" NSH_RESET);
+            status = 1;
+        } else if (color_output()) {
+            printf(NSH_OK "Exported: " NSH_ACCENT "%s" NSH_FG "=\n" NSH_RESET,
+                   var_name);
+            fflush(stdout);
+        }
+    }
+    return status;
+}
+
+static int builtin_echo(int argc, char **argv) {
+    int interactive = color_output();
+
+    // Reset colors so echo output uses default terminal colors
+    if (interactive) {
+        printf(NSH_RESET);
+    }
+
+    // Variables were already expanded by the parser
+    for (int i = 1; i < argc; i++) {
+        fputs(argv[i], stdout);
+        // Print space between arguments (except after last one)
+        if (i < argc - 1) {
+            putchar(' ');
+        }
+    }
+    printf("\n");
+
+    // Reset colors after echo output, then restore prompt color
+    if (interactive) {
+        printf(NSH_RESET NSH_ACCENT);
+    }
+    fflush(stdout);
+    return 0;
+}
+
+static int builtin_clear(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    linenoiseClearScreen();
+    banner();
+    return 0;
+}
+
+static int builtin_hash(int argc, char **argv) {
+    int status = 0;
+
+    if (argc == 1) {
+        path_hash_print();
+    } else if (strcmp(argv[1], "-r") == 0) {
+        path_hash_reset();
+        completion_reset();
+    } else {
+        for (int i = 1; i < argc; i++) {
+            if (path_hash_add(argv[i]) != 0) {
+                fprintf(stderr, NSH_ERR "hash: %s: not found\n" NSH_RESET, argv[i]);
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
+
+static int builtin_help(int argc, char **argv) {
+    int color = color_output();
+
+    (void)argc;
+    (void)argv;
+    for (size_t i = 0; i < BUILTIN_COUNT; i++) {
+        printf(color ? NSH_ACCENT "  %-24s" NSH_RESET NSH_FG "%s\n" NSH_RESET : "  %-24s%s\n",
+               builtins[i].usage, builtins[i].help);
+    }
+    printf("\n");
+    fflush(stdout);
+    return 0;
+}
+
+static int builtin_jobs(int argc, char **argv) {
+    return jobs_list(argc, argv);
+}
+
+static int builtin_fg(int argc, char **argv) {
+    return jobs_fg(argc, argv);
+}
+
+static int builtin_bg(int argc, char **argv) {
+    return jobs_bg(argc, argv);
+}
+
+static int builtin_wait(int argc, char **argv) {
+    return jobs_wait(argc, argv);
+}
+
+static int builtin_parallel(int argc, char **argv) {
+    return parallel_run(argc, argv);
+}
@@ -0,0 +1,58 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#include "libs/history.h"
+#include "libs/utils.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HISTORY_FILE "history.txt"
+#define HISTORY_DEFAULT_SIZE 10000
+
+static char history_path[PATH_MAX] = HISTORY_FILE;
+
+void history_init(void) {
+    char cwd[PATH_MAX - sizeof("/" HISTORY_FILE)];
+    const char *size = getenv("NSH_HISTSIZE");
+    char *end;
+    long max_len = HISTORY_DEFAULT_SIZE;
+
+    // NSH_HISTSIZE sets how many commands are kept, ignored if not a number
+    if (size != NULL && *size != '\0') {
+        long value = strtol(size, &end, 10);
+        if (*end == '\0' && value > 0 && value <= INT_MAX) {
+            max_len = value;
+        }
+    }
+    linenoiseHistorySetMaxLen((int)max_len);
+
+    // A repeated command moves to the end of the history unless
+    // NSH_HISTDEDUP=0 asks to keep every copy
+    const char *dedup = getenv("NSH_HISTDEDUP");
+    linenoiseHistorySetDedup(dedup == NULL || strcmp(dedup, "0") != 0);
+
+    // Remember the absolute path so `cd` does not move the history file
+    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+        snprintf(history_path, sizeof(history_path), "%s/" HISTORY_FILE, cwd);
+    }
+    linenoiseHistoryLoad(history_path);
+}
+
+void history_record(const char *line) {
+    // Only lines that really entered the history (not repeats) are written
+    if (linenoiseHistoryAdd(line)) {
+        linenoiseHistoryAppend(history_path, line);
+    }
+}
+
+void history_shutdown(void) {
+    linenoiseHistoryCompact(history_path);
+}
@@ -0,0 +1,151 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#include "libs/input.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BATCH_BLOCK (64 * 1024)
+
+int batch_open(struct batch_input *in, int fd) {
+    struct stat st;
+    off_t start;
+
+    memset(in, 0, sizeof(*in));
+    in->fd = fd;
+
+    // A file is mapped from where the shell's stdin stands. Lines are cut
+    // by writing their '\0' over the '\n', in private copies of the pages.
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (start = lseek(fd, 0, SEEK_CUR)) != -1 &&
+        st.st_size > start) {
+        off_t base = start - start % sysconf(_SC_PAGESIZE);
+        size_t size = st.st_size - base;
+        void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, base);
+
+        if (addr != MAP_FAILED) {
+            madvise(addr, size, MADV_SEQUENTIAL);
+            in->data = addr;
+            in->size = in->len = size;
+            in->pos = start - base;
+            in->base = base;
+            in->mapped = 1;
+            return 0;
+        }
+    }
+
+    in->size = BATCH_BLOCK;
+    in->data = malloc(in->size);
+    return in->data ? 0 : -1;
+}
+
+static char *next_mapped(struct batch_input *in) {
+    char *line, *nl;
+
+    // The commands share the shell's stdin. One that read from it moved the
+    // file offset, and the shell goes on from there, like it would have
+    // reading the file itself.
+    if (in->synced) {
+        off_t offset = lseek(in->fd, 0, SEEK_CUR);
+        if (offset >= in->base && offset - in->base <= (off_t)in->len) {
+            in->pos = offset - in->base;
+        }
+        in->synced = 0;
+    }
+    if (in->pos >= in->len) {
+        return NULL;
+    }
+
+    line = in->data + in->pos;
+    nl = memchr(line, '\n', in->len - in->pos);
+    if (nl != NULL) {
+        *nl = '\0';
+        in->pos = nl + 1 - in->data;
+    } else {
+        // There may be no room after the last line for its '\0'
+        free(in->tail);
+        in->tail = strndup(line, in->len - in->pos);
+        in->pos = in->len;
+        line = in->tail;
+    }
+    return line;
+}
+
+static char *next_read(struct batch_input *in) {
+    size_t scanned = in->pos; // Bytes from 'pos' on known to hold no '\n'
+
+    for (;;) {
+        char *nl = memchr(in->data + scanned, '\n', in->len - scanned);
+        char *line = in->data + in->pos;
+        ssize_t n;
+
+        if (nl != NULL) {
+            *nl = '\0';
+            in->pos = nl + 1 - in->data;
+            return line;
+        }
+        if (in->eof) {
+            if (in->pos == in->len) {
+                return NULL;
+            }
+            in->data[in->len] = '\0';
+            in->pos = in->len;
+            return line;
+        }
+
+        // Move the start of the line to the front, or make the buffer
+        // larger if it already is there, and read more after it
+        if (in->pos > 0) {
+            memmove(in->data, line, in->len - in->pos);
+            in->len -= in->pos;
+            in->pos = 0;
+        } else if (in->len + 1 == in->size) {
+            char *bigger = realloc(in->data, in->size * 2);
+            if (bigger == NULL) {
+                return NULL;
+            }
+            in->data = bigger;
+            in->size *= 2;
+        }
+        scanned = in->len;
+        n = read(in->fd, in->data + in->len, in->size - in->len - 1);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            in->eof = 1;
+        } else {
+            in->len += n;
+        }
+    }
+}
+
+char *batch_next(struct batch_input *in) {
+    return in->mapped ? next_mapped(in) : next_read(in);
+}
+
+void batch_sync(struct batch_input *in) {
+    if (in->mapped && !in->synced) {
+        lseek(in->fd, in->base + in->pos, SEEK_SET);
+        in->synced = 1;
+    }
+}
+
+void batch_close(struct batch_input *in) {
+    if (in->mapped) {
+        munmap(in->data, in->size);
+    } else {
+        free(in->data);
+    }
+    free(in->tail);
+    in->data = NULL;
+    in->tail = NULL;
+}
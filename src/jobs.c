@@ -0,0 +1,654 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#define _GNU_SOURCE
+
+#include "libs/jobs.h"
+#include "libs/utils.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Children are never waited for from a signal handler. SIGCHLD (and Ctrl-C
+ * in an interactive shell) stay blocked and are read from a signalfd that
+ * sits in an epoll set, next to whatever the shell is waiting on, e.g. the
+ * terminal at the prompt. A child changing state wakes the shell up and is
+ * reaped right away, without polling. */
+static struct job *jobs = NULL; // The job table, by increasing id
+static int job_control = 0;
+static pid_t shell_pgid;
+static sigset_t job_signals;
+static int signal_fd = -1;
+static int epoll_fd = -1;
+static int watched_fds[2] = {-1, -1}; // The descriptors waited on besides signal_fd
+static unsigned long use_count = 0;
+static pid_t last_pid = 0;
+static int window_changed = 0;
+static int subshell = 0;
+
+void jobs_init(int interactive) {
+    struct epoll_event ev = {.events = EPOLLIN};
+
+    sigemptyset(&job_signals);
+    sigaddset(&job_signals, SIGCHLD);
+    if (interactive && isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp()) {
+        // Ctrl-Z and terminal access only concern the jobs. Ctrl-C is read
+        // from the signalfd, where it interrupts 'wait'.
+        signal(SIGQUIT, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+        sigaddset(&job_signals, SIGINT);
+        // A resize of the terminal is noted here too, so that the line
+        // being edited at the prompt is redrawn right away
+        sigaddset(&job_signals, SIGWINCH);
+        shell_pgid = getpgrp();
+        job_control = 1;
+    }
+    sigprocmask(SIG_BLOCK, &job_signals, NULL);
+
+    signal_fd = signalfd(-1, &job_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    ev.data.fd = signal_fd;
+    if (signal_fd == -1 || epoll_fd == -1 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) == -1) {
+        // jobs_wait_event() falls back to sigwaitinfo()
+        perror(NSH_ERR "nsh: signalfd" NSH_RESET);
+        if (epoll_fd != -1) {
+            close(epoll_fd);
+            epoll_fd = -1;
+        }
+    }
+}
+
+int jobs_control(void) {
+    return job_control;
+}
+
+void jobs_subshell(void) {
+    struct epoll_event ev = {.events = EPOLLIN};
+    struct job *next;
+
+    // The jobs are the shell's children, not ours: forget them untouched
+    for (struct job *job = jobs; job != NULL; job = next) {
+        next = job->next;
+        job_free(job);
+    }
+    jobs = NULL;
+    job_control = 0;
+    subshell = 1;
+
+    // Ctrl-C ends the child, only child reaping goes through the signalfd
+    sigemptyset(&job_signals);
+    sigaddset(&job_signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &job_signals, NULL);
+
+    // The signalfd and the epoll instance of the shell were closed by
+    // launch_function(), as exec would have closed them: make our own
+    watched_fds[0] = watched_fds[1] = -1;
+    signal_fd = signalfd(-1, &job_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    ev.data.fd = signal_fd;
+    if (signal_fd == -1 || epoll_fd == -1 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) == -1) {
+        // jobs_wait_event() falls back to sigwaitinfo()
+        if (epoll_fd != -1) {
+            close(epoll_fd);
+            epoll_fd = -1;
+        }
+    }
+}
+
+int jobs_in_subshell(void) {
+    return subshell;
+}
+
+// Keep the command line without the final '&' and blanks
+static char *job_text(const char *line) {
+    size_t len;
+
+    line += strspn(line, " \t");
+    len = strlen(line);
+    while (len > 0 && strchr(" \t\r\n", line[len - 1]) != NULL) {
+        len--;
+    }
+    if (len > 0 && line[len - 1] == '&') {
+        len--;
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) {
+            len--;
+        }
+    }
+    return strndup(line, len);
+}
+
+struct job *job_create(const char *command, int max_procs) {
+    struct job *job = calloc(1, sizeof(*job));
+
+    if (job == NULL) {
+        return NULL;
+    }
+    job->procs = calloc(max_procs, sizeof(*job->procs));
+    job->command = job_text(command);
+    if (job->procs == NULL || job->command == NULL) {
+        job_free(job);
+        return NULL;
+    }
+    job->pgid = job_control ? 0 : -1;
+    return job;
+}
+
+void job_add_process(struct job *job, pid_t pid) {
+    job->procs[job->count].pid = pid;
+    job->procs[job->count].state = JOB_RUNNING;
+    job->count++;
+    if (job->pgid == 0) {
+        job->pgid = pid;
+    }
+}
+
+void job_free(struct job *job) {
+    free(job->procs);
+    free(job->command);
+    free(job);
+}
+
+static void job_insert(struct job *job) {
+    struct job **link = &jobs;
+    int id = 1;
+
+    while (*link != NULL) {
+        id = (*link)->id + 1;
+        link = &(*link)->next;
+    }
+    job->id = id;
+    job->next = NULL;
+    *link = job;
+}
+
+static void job_remove(struct job *job) {
+    for (struct job **link = &jobs; *link != NULL; link = &(*link)->next) {
+        if (*link == job) {
+            *link = job->next;
+            break;
+        }
+    }
+    job->id = 0;
+}
+
+// A job runs while any of its processes does, and is done once all are
+static int job_state(const struct job *job) {
+    int state = JOB_DONE;
+
+    for (int i = 0; i < job->count; i++) {
+        if (job->procs[i].state == JOB_RUNNING) {
+            return JOB_RUNNING;
+        }
+        if (job->procs[i].state == JOB_STOPPED) {
+            state = JOB_STOPPED;
+        }
+    }
+    return state;
+}
+
+static int exit_status(int wstatus) {
+    if (WIFEXITED(wstatus)) {
+        return WEXITSTATUS(wstatus);
+    }
+    if (WIFSIGNALED(wstatus)) {
+        return 128 + WTERMSIG(wstatus);
+    }
+    return -1;
+}
+
+static void update_process(struct job *job, struct job_process *proc, int wstatus) {
+    int before = job_state(job);
+
+    if (WIFSTOPPED(wstatus)) {
+        proc->state = JOB_STOPPED;
+    } else if (WIFCONTINUED(wstatus)) {
+        proc->state = JOB_RUNNING;
+    } else {
+        proc->state = JOB_DONE;
+        proc->wstatus = wstatus;
+    }
+    if (job_state(job) != before) {
+        job->notified = 0;
+    }
+}
+
+// Collect the state changes of the processes in the job table. Only their
+// own pids are waited for, so children waited for elsewhere are left alone.
+static void reap_jobs(void) {
+    for (struct job *job = jobs; job != NULL; job = job->next) {
+        for (int i = 0; i < job->count; i++) {
+            struct job_process *proc = &job->procs[i];
+            int wstatus;
+            pid_t pid;
+
+            while (proc->state != JOB_DONE &&
+                   (pid = waitpid(proc->pid, &wstatus, WNOHANG | WUNTRACED | WCONTINUED)) != 0) {
+                if (pid == -1) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    // Not our child anymore: nothing left to wait for
+                    proc->state = JOB_DONE;
+                    proc->wstatus = 0;
+                    break;
+                }
+                update_process(job, proc, wstatus);
+            }
+        }
+    }
+}
+
+// Empty the signalfd. Returns 1 if Ctrl-C was among the signals.
+static int read_signals(void) {
+    struct signalfd_siginfo info;
+    int interrupted = 0;
+
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGINT) {
+            interrupted = 1;
+        } else if (info.ssi_signo == SIGWINCH) {
+            window_changed = 1;
+        }
+    }
+    return interrupted;
+}
+
+// Have epoll watch 'fd' (-1 for none) in the place of watched_fds[slot]
+static int watch_fd(int slot, int fd) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+
+    if (fd == watched_fds[slot]) {
+        return 0;
+    }
+    if (watched_fds[slot] != -1) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watched_fds[slot], NULL);
+        watched_fds[slot] = -1;
+    }
+    if (fd != -1) {
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            return -1;
+        }
+        watched_fds[slot] = fd;
+    }
+    return 0;
+}
+
+int jobs_wait_event(int fd, int fd2) {
+    struct epoll_event events[3];
+    int interrupted = 0, ready = 0;
+    int n;
+
+    if (epoll_fd == -1) {
+        if (fd != -1) {
+            return 1;
+        }
+        n = sigwaitinfo(&job_signals, NULL);
+        window_changed |= n == SIGWINCH;
+        reap_jobs();
+        return n == SIGINT ? -1 : 0;
+    }
+
+    if (watch_fd(0, fd) == -1) {
+        return 1;
+    }
+    // Should 'fd2' fail to be watched, waiting for 'fd' alone still works
+    watch_fd(1, fd2);
+
+    while ((n = epoll_wait(epoll_fd, events, 3, -1)) == -1) {
+        if (errno != EINTR) {
+            return fd != -1 ? 1 : -1;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == signal_fd) {
+            interrupted = read_signals();
+            reap_jobs();
+        } else {
+            ready = 1;
+        }
+    }
+    return interrupted ? -1 : ready;
+}
+
+int jobs_window_changed(void) {
+    static const struct timespec now = {0, 0};
+    int changed = window_changed;
+    sigset_t winch;
+
+    // A resize while a command ran in the foreground is still queued
+    sigemptyset(&winch);
+    sigaddset(&winch, SIGWINCH);
+    if (job_control && sigtimedwait(&winch, NULL, &now) == SIGWINCH) {
+        changed = 1;
+    }
+    window_changed = 0;
+    return changed;
+}
+
+// The current job (+) is the one stopped or put in the background last,
+// the previous one (-) the one before it
+static struct job *current_job(int previous) {
+    struct job *current = NULL, *before = NULL;
+
+    for (struct job *job = jobs; job != NULL; job = job->next) {
+        if (current == NULL || job->used > current->used) {
+            before = current;
+            current = job;
+        } else if (before == NULL || job->used > before->used) {
+            before = job;
+        }
+    }
+    return previous ? before : current;
+}
+
+static void print_job(const struct job *job, int state) {
+    char desc[64];
+    char mark = ' ';
+
+    if (job == current_job(0)) {
+        mark = '+';
+    } else if (job == current_job(1)) {
+        mark = '-';
+    }
+
+    if (state == JOB_RUNNING) {
+        strcpy(desc, "Running");
+    } else if (state == JOB_STOPPED) {
+        strcpy(desc, "Stopped");
+    } else {
+        int wstatus = job->procs[job->count - 1].wstatus;
+        if (WIFSIGNALED(wstatus)) {
+            snprintf(desc, sizeof(desc), "%s", strsignal(WTERMSIG(wstatus)));
+        } else if (exit_status(wstatus) != 0) {
+            snprintf(desc, sizeof(desc), "Exit %d", exit_status(wstatus));
+        } else {
+            strcpy(desc, "Done");
+        }
+    }
+    printf("[%d]%c  %-24s%s%s\n", job->id, mark, desc, job->command,
+           state == JOB_RUNNING ? " &" : "");
+}
+
+int job_foreground(struct job *job) {
+    int stopped = 0;
+    int status;
+
+    for (int i = 0; i < job->count; i++) {
+        struct job_process *proc = &job->procs[i];
+        int wstatus;
+
+        while (proc->state == JOB_RUNNING) {
+            if (waitpid(proc->pid, &wstatus, job_control ? WUNTRACED : 0) == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                proc->state = JOB_DONE;
+                proc->wstatus = 0;
+                break;
+            }
+            update_process(job, proc, wstatus);
+        }
+        stopped |= (proc->state == JOB_STOPPED);
+    }
+    if (job->pgid > 0) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+    }
+
+    if (stopped) {
+        if (job->id == 0) {
+            job_insert(job);
+        }
+        job->used = ++use_count;
+        job->notified = 1;
+        printf("\n");
+        print_job(job, JOB_STOPPED);
+        fflush(stdout);
+        return 128 + SIGTSTP;
+    }
+
+    int wstatus = job->procs[job->count - 1].wstatus;
+    if (job_control && WIFSIGNALED(wstatus)) {
+        // Like other shells: a line break after ^C, the reason for the rest
+        if (WTERMSIG(wstatus) == SIGINT) {
+            printf("\n");
+            fflush(stdout);
+        } else if (WTERMSIG(wstatus) != SIGPIPE) {
+            fprintf(stderr, "%s%s\n", strsignal(WTERMSIG(wstatus)),
+                    WCOREDUMP(wstatus) ? " (core dumped)" : "");
+        }
+    }
+    status = exit_status(wstatus);
+    if (job->id != 0) {
+        job_remove(job);
+    }
+    job_free(job);
+    return status;
+}
+
+void job_background(struct job *job) {
+    job_insert(job);
+    job->used = ++use_count;
+    last_pid = job->procs[job->count - 1].pid;
+    if (job_control) {
+        printf("[%d] %d\n", job->id, (int)last_pid);
+        fflush(stdout);
+    }
+}
+
+void jobs_notify(void) {
+    struct job *next;
+
+    if (signal_fd != -1) {
+        read_signals();
+    }
+    reap_jobs();
+    for (struct job *job = jobs; job != NULL; job = next) {
+        int state = job_state(job);
+
+        next = job->next;
+        if (state == JOB_DONE) {
+            if (job_control) {
+                print_job(job, state);
+            }
+            job_remove(job);
+            job_free(job);
+        } else if (state == JOB_STOPPED && !job->notified) {
+            print_job(job, state);
+            job->notified = 1;
+        }
+    }
+    fflush(stdout);
+}
+
+pid_t jobs_last_pid(void) {
+    return last_pid;
+}
+
+// Find the job named by 'spec': %N or N, %+, %% or nothing for the current
+// job, %- for the previous one
+static struct job *find_job(const char *builtin, const char *spec) {
+    struct job *job = NULL;
+
+    if (spec == NULL || strcmp(spec, "%") == 0 || strcmp(spec, "%%") == 0 ||
+        strcmp(spec, "%+") == 0) {
+        job = current_job(0);
+    } else if (strcmp(spec, "%-") == 0) {
+        job = current_job(1);
+    } else {
+        const char *digits = spec + (*spec == '%');
+        char *end;
+        long id = strtol(digits, &end, 10);
+
+        if (*digits != '\0' && *end == '\0') {
+            for (job = jobs; job != NULL && job->id != id; job = job->next) {
+            }
+        }
+    }
+    if (job == NULL) {
+        fprintf(stderr, NSH_ERR "%s: %s: no such job\n" NSH_RESET, builtin,
+                spec ? spec : "current");
+    }
+    return job;
+}
+
+static void job_continue(struct job *job) {
+    for (int i = 0; i < job->count; i++) {
+        if (job->procs[i].state == JOB_STOPPED) {
+            job->procs[i].state = JOB_RUNNING;
+        }
+    }
+    if (job->pgid > 0) {
+        kill(-job->pgid, SIGCONT);
+    } else {
+        for (int i = 0; i < job->count; i++) {
+            kill(job->procs[i].pid, SIGCONT);
+        }
+    }
+}
+
+int jobs_list(int argc, char **argv) {
+    struct job *next;
+
+    (void)argc;
+    (void)argv;
+    reap_jobs();
+    for (struct job *job = jobs; job != NULL; job = next) {
+        int state = job_state(job);
+
+        next = job->next;
+        print_job(job, state);
+        job->notified = 1;
+        if (state == JOB_DONE) {
+            job_remove(job);
+            job_free(job);
+        }
+    }
+    fflush(stdout);
+    return 0;
+}
+
+int jobs_fg(int argc, char **argv) {
+    struct job *job;
+
+    if (!job_control) {
+        fprintf(stderr, NSH_ERR "fg: no job control\n" NSH_RESET);
+        return 1;
+    }
+    reap_jobs();
+    if ((job = find_job("fg", argc > 1 ? argv[1] : NULL)) == NULL) {
+        return 1;
+    }
+    printf("%s\n", job->command);
+    fflush(stdout);
+    tcsetpgrp(STDIN_FILENO, job->pgid);
+    job_continue(job);
+    return job_foreground(job);
+}
+
+int jobs_bg(int argc, char **argv) {
+    struct job *job;
+
+    if (!job_control) {
+        fprintf(stderr, NSH_ERR "bg: no job control\n" NSH_RESET);
+        return 1;
+    }
+    reap_jobs();
+    if ((job = find_job("bg", argc > 1 ? argv[1] : NULL)) == NULL) {
+        return 1;
+    }
+    if (job_state(job) != JOB_STOPPED) {
+        fprintf(stderr, NSH_ERR "bg: job %d already in background\n" NSH_RESET, job->id);
+        return 0;
+    }
+    job_continue(job);
+    job->used = ++use_count;
+    printf("[%d]+ %s &\n", job->id, job->command);
+    fflush(stdout);
+    return 0;
+}
+
+// Find the job and process of a pid started by the shell
+static struct job *find_pid(pid_t pid, struct job_process **proc) {
+    for (struct job *job = jobs; job != NULL; job = job->next) {
+        for (int i = 0; i < job->count; i++) {
+            if (job->procs[i].pid == pid) {
+                *proc = &job->procs[i];
+                return job;
+            }
+        }
+    }
+    return NULL;
+}
+
+int jobs_wait(int argc, char **argv) {
+    int status = 0;
+
+    reap_jobs();
+    if (argc == 1) {
+        // Every running job. Stopped ones would never finish.
+        struct job *job = jobs, *next;
+        while (job != NULL) {
+            if (job_state(job) == JOB_RUNNING) {
+                if (jobs_wait_event(-1, -1) == -1) {
+                    return 130;
+                }
+                job = jobs;
+                continue;
+            }
+            job = job->next;
+        }
+        for (job = jobs; job != NULL; job = next) {
+            next = job->next;
+            if (job_state(job) == JOB_DONE) {
+                job_remove(job);
+                job_free(job);
+            }
+        }
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        struct job_process *proc = NULL;
+        struct job *job;
+
+        if (argv[i][0] == '%') {
+            job = find_job("wait", argv[i]);
+        } else if ((job = find_pid(atoi(argv[i]), &proc)) == NULL) {
+            fprintf(stderr, NSH_ERR "wait: pid %s is not a child of this shell\n" NSH_RESET, argv[i]);
+        }
+        if (job == NULL) {
+            status = 127;
+            continue;
+        }
+        while (proc ? proc->state == JOB_RUNNING : job_state(job) == JOB_RUNNING) {
+            if (jobs_wait_event(-1, -1) == -1) {
+                return 130;
+            }
+        }
+        if ((proc ? proc->state : job_state(job)) == JOB_STOPPED) {
+            status = 128 + SIGTSTP;
+            continue;
+        }
+        status = exit_status(proc ? proc->wstatus : job->procs[job->count - 1].wstatus);
+        if (job_state(job) == JOB_DONE) {
+            job_remove(job);
+            job_free(job);
+        }
+    }
+    return status;
+}
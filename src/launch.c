@@ -0,0 +1,239 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#define _GNU_SOURCE
+
+#include "libs/launch.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static enum launch_mode mode = LAUNCH_SPAWN;
+
+// glibc 2.35 can hand the terminal to the child between setpgid() and exec,
+// before the child can read from it. Older ones do it from the parent.
+#ifdef __GLIBC_PREREQ
+#if __GLIBC_PREREQ(2, 35)
+#define HAVE_SPAWN_TCSETPGRP 1
+#endif
+#endif
+
+// Signals an interactive shell ignores, and which children must get back
+static void ignored_signals(sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGQUIT);
+    sigaddset(set, SIGTSTP);
+    sigaddset(set, SIGTTIN);
+    sigaddset(set, SIGTTOU);
+    sigaddset(set, SIGPIPE);
+}
+
+// Runs in the forked child: what posix_spawn() does from its attributes
+// and file actions.
+static void setup_child(const struct launch_options *opts) {
+    sigset_t set;
+
+    if (opts != NULL) {
+        if (opts->pgid >= 0) {
+            setpgid(0, opts->pgid);
+        }
+        if (opts->foreground) {
+            tcsetpgrp(STDIN_FILENO, getpgrp());
+        }
+        for (int i = 0; i < opts->fd_count; i++) {
+            if (opts->fds[i].from == opts->fds[i].to) {
+                fcntl(opts->fds[i].to, F_SETFD, 0);
+            } else {
+                dup2(opts->fds[i].from, opts->fds[i].to);
+            }
+        }
+    }
+    ignored_signals(&set);
+    for (int sig = 1; sig < NSIG; sig++) {
+        if (sigismember(&set, sig) == 1) {
+            signal(sig, SIG_DFL);
+        }
+    }
+    sigemptyset(&set);
+    sigprocmask(SIG_SETMASK, &set, NULL);
+}
+
+void launch_set_mode(enum launch_mode new_mode) {
+    mode = new_mode;
+}
+
+// Classic fork() + exec(). Also used as the fallback for programs that
+// posix_spawn() refuses to run: execvp() hands files without a shebang
+// (ENOEXEC) over to /bin/sh, posix_spawnp() does not.
+static pid_t launch_fork(const char *path, char *const argv[],
+                         const struct launch_options *opts) {
+    int errpipe[2];
+    int err = 0;
+
+    // Report exec failures back through a close-on-exec pipe so callers
+    // see the same errno they would get from posix_spawn().
+    if (pipe2(errpipe, O_CLOEXEC) == -1) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(errpipe[0]);
+        setup_child(opts);
+        execvp(path, argv);
+        err = errno;
+        if (write(errpipe[1], &err, sizeof(err)) == -1) {
+            // Nothing more we can do from here.
+        }
+        _exit(127);
+    }
+
+    close(errpipe[1]);
+    if (pid < 0) {
+        err = errno;
+        close(errpipe[0]);
+        errno = err;
+        return -1;
+    }
+
+    if (read(errpipe[0], &err, sizeof(err)) == sizeof(err)) {
+        // exec failed in the child: collect it and report the error.
+        waitpid(pid, NULL, 0);
+        close(errpipe[0]);
+        errno = err;
+        return -1;
+    }
+    close(errpipe[0]);
+    return pid;
+}
+
+pid_t launch_process(const char *path, char *const argv[], const struct launch_options *opts) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    sigset_t set;
+    pid_t pid;
+    int err;
+
+    if (mode == LAUNCH_FORK) {
+        return launch_fork(path, argv, opts);
+    }
+
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+    ignored_signals(&set);
+    posix_spawnattr_setsigdefault(&attr, &set);
+    sigemptyset(&set);
+    posix_spawnattr_setsigmask(&attr, &set);
+    if (opts != NULL) {
+        if (opts->pgid >= 0) {
+            flags |= POSIX_SPAWN_SETPGROUP;
+            posix_spawnattr_setpgroup(&attr, opts->pgid);
+        }
+#ifdef HAVE_SPAWN_TCSETPGRP
+        // Runs before the dups below, while stdin is still the terminal
+        if (opts->foreground) {
+            posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+        }
+#endif
+        for (int i = 0; i < opts->fd_count; i++) {
+            posix_spawn_file_actions_adddup2(&actions, opts->fds[i].from, opts->fds[i].to);
+        }
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    if (strchr(path, '/') != NULL) {
+        err = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+    } else {
+        err = posix_spawnp(&pid, path, &actions, &attr, argv, environ);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (err == ENOEXEC) {
+        return launch_fork(path, argv, opts);
+    }
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+#ifndef HAVE_SPAWN_TCSETPGRP
+    if (opts != NULL && opts->foreground) {
+        tcsetpgrp(STDIN_FILENO, getpgid(pid));
+    }
+#endif
+    return pid;
+}
+
+// In a forked child that does not exec: close what exec would have closed,
+// such as the pipes of the other stages of a pipeline
+static void close_cloexec_fds(void) {
+    DIR *dir = opendir("/proc/self/fd");
+    struct dirent *e;
+
+    if (dir == NULL) {
+        return;
+    }
+    while ((e = readdir(dir)) != NULL) {
+        int fd = atoi(e->d_name);
+        int flags;
+
+        if (fd > STDERR_FILENO && fd != dirfd(dir) && (flags = fcntl(fd, F_GETFD)) != -1 &&
+            (flags & FD_CLOEXEC)) {
+            close(fd);
+        }
+    }
+    closedir(dir);
+}
+
+pid_t launch_function(int (*fn)(void *), void *arg, const struct launch_options *opts) {
+    pid_t pid;
+
+    // Output buffered by the shell must not be written twice
+    fflush(stdout);
+    fflush(stderr);
+    pid = fork();
+    if (pid == 0) {
+        int status;
+
+        setup_child(opts);
+        close_cloexec_fds();
+        status = fn(arg);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(status);
+    }
+    return pid;
+}
+
+int wait_process(pid_t pid) {
+    int status;
+
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return -1;
+}
@@ -0,0 +1,30 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_BUILTINS_H
+#define NSH_BUILTINS_H
+
+#include <stddef.h>
+
+// A builtin gets the parsed command line and returns its exit status
+typedef int (*builtin_fn)(int argc, char **argv);
+
+struct builtin {
+    const char *name;  // Command name
+    builtin_fn fn;     // Handler
+    const char *usage; // Synopsis shown by `help`
+    const char *help;  // One-line description shown by `help`
+};
+
+// Find the builtin called 'name', or NULL if there is none
+const struct builtin *builtin_lookup(const char *name);
+
+// The registry itself, sorted by name
+const struct builtin *builtin_table(size_t *count);
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_HISTORY_H
+#define NSH_HISTORY_H
+
+// Load the history file. It is history.txt in the directory nsh was
+// started from, and stays there when the shell changes directory. The
+// number of commands kept is taken from $NSH_HISTSIZE (default 10000), and
+// repeated commands are only kept once unless $NSH_HISTDEDUP is 0.
+void history_init(void);
+
+// Add a command to the history and append it to the history file
+void history_record(const char *line);
+
+// Compact the history file if appending made it grow too much. Called
+// when the shell exits.
+void history_shutdown(void);
+
+#endif
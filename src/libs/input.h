@@ -0,0 +1,45 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_INPUT_H
+#define NSH_INPUT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Reads the command lines of a non-interactive shell, when stdin is a pipe
+ * or a file. A regular file is mapped, anything else is read in large
+ * blocks. Lines are split in place and handed out without being copied. */
+struct batch_input {
+    int fd;
+    char *data;  // The mapping, or the read buffer
+    size_t len;  // Bytes of input in 'data'
+    size_t pos;  // Start of the next line in 'data'
+    size_t size; // Size of the mapping or of the buffer
+    int mapped;
+    off_t base;  // File offset of data[0], when mapped
+    int synced;  // The file offset was set to 'pos' for a command
+    char *tail;  // Copy of a last line that has no '\n', when mapped
+    int eof;
+};
+
+// Start reading lines from 'fd'. Returns -1 if no buffer could be set up.
+int batch_open(struct batch_input *in, int fd);
+
+// The next line, without its '\n', or NULL at the end of the input. The
+// line is only valid until the next call.
+char *batch_next(struct batch_input *in);
+
+// Before running a command: point the file offset of a mapped stdin just
+// after the current line, so the command reads what follows it. The next
+// batch_next() then goes on from wherever the command left the offset.
+void batch_sync(struct batch_input *in);
+
+void batch_close(struct batch_input *in);
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_JOBS_H
+#define NSH_JOBS_H
+
+#include <sys/types.h>
+
+#define JOB_RUNNING 0
+#define JOB_STOPPED 1
+#define JOB_DONE 2
+
+/* A process of a job. */
+struct job_process {
+    pid_t pid;
+    int state;   /* JOB_RUNNING, JOB_STOPPED or JOB_DONE */
+    int wstatus; /* As returned by waitpid(), once JOB_DONE */
+};
+
+/* The external commands of one pipeline, started together. */
+struct job {
+    int id;             /* %N, 0 while the job is not in the job table */
+    pid_t pgid;         /* -1 without job control, 0 until the first process starts */
+    int count;
+    struct job_process *procs;
+    char *command;      /* The command line, for jobs and fg */
+    int notified;       /* The current state has been reported */
+    unsigned long used; /* When it was last stopped or put in the background */
+    struct job *next;
+};
+
+// Set up child reaping through a signalfd. An interactive shell also gets
+// job control: it ignores the job control signals, and each job runs in a
+// process group of its own that owns the terminal while in the foreground.
+void jobs_init(int interactive);
+int jobs_control(void);
+
+// Called in a child forked to run a builtin of a pipeline: the jobs and the
+// terminal stay with the shell, and 'exit' only ends the child.
+void jobs_subshell(void);
+int jobs_in_subshell(void);
+
+// A job for the pipeline 'command', with room for 'max_procs' processes.
+// The processes get job->pgid as their process group when they start.
+struct job *job_create(const char *command, int max_procs);
+void job_add_process(struct job *job, pid_t pid);
+void job_free(struct job *job);
+
+// Wait for a job while it owns the terminal. A job that stops goes to the
+// job table. Returns the exit status of its last process, or 128 + SIGTSTP
+// if it was stopped.
+int job_foreground(struct job *job);
+
+// Add a job to the job table and let it run without waiting for it
+void job_background(struct job *job);
+
+// Wait until 'fd' or 'fd2' (-1 for none) can be read from or a child changes
+// state, reaping it. Returns 1 when one of the descriptors is ready, 0 after
+// a child event or a resize of the terminal, and -1 if the wait was
+// interrupted by Ctrl-C.
+int jobs_wait_event(int fd, int fd2);
+
+// True once after the terminal was resized (SIGWINCH), in an interactive shell
+int jobs_window_changed(void);
+
+// Report the jobs that finished or stopped since the last prompt
+void jobs_notify(void);
+
+// Process id of the last command started in the background, or 0
+pid_t jobs_last_pid(void);
+
+// The jobs, fg, bg and wait builtins
+int jobs_list(int argc, char **argv);
+int jobs_fg(int argc, char **argv);
+int jobs_bg(int argc, char **argv);
+int jobs_wait(int argc, char **argv);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_LAUNCH_H
+#define NSH_LAUNCH_H
+
+#include <sys/types.h>
+
+/* How child processes are created. LAUNCH_SPAWN uses posix_spawn(), which
+ * glibc implements with clone(CLONE_VM|CLONE_VFORK) so the page tables of
+ * the shell are never copied. LAUNCH_FORK is the classic fork() + exec(). */
+enum launch_mode {
+    LAUNCH_SPAWN,
+    LAUNCH_FORK
+};
+
+void launch_set_mode(enum launch_mode mode);
+
+#define LAUNCH_MAX_FDS 16
+
+/* How to set up a child before it execs. The descriptors are installed in
+ * order, each like dup2(from, to) in the child, so they are never copied
+ * through the shell. */
+struct launch_options {
+    int fd_count;
+    struct {
+        int from;
+        int to;
+    } fds[LAUNCH_MAX_FDS];
+    pid_t pgid;     /* Process group to join, 0 for a new one, -1 to stay in the shell's */
+    int foreground; /* Give the terminal to the child's process group */
+};
+
+// Start 'argv' as a child process. If 'path' contains a '/' it is executed
+// as-is, otherwise it is searched in $PATH. 'opts' may be NULL. Signals the
+// shell ignores are reset to their defaults in the child. Returns the child
+// pid, or -1 with errno set if the program could not be started.
+pid_t launch_process(const char *path, char *const argv[], const struct launch_options *opts);
+
+// Run fn(arg) in a forked child set up like launch_process() sets up its
+// children, which then exits with what it returned. The descriptors marked
+// close-on-exec are closed before fn() runs, as exec would close them. For
+// builtins that must not act on the shell itself. Returns the child pid, or
+// -1 with errno set.
+pid_t launch_function(int (*fn)(void *), void *arg, const struct launch_options *opts);
+
+// Wait for a child started by launch_process() and return its exit status
+// (128 + signal number if it was killed by a signal).
+int wait_process(pid_t pid);
+
+#endif
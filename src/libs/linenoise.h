@@ -67,6 +67,29 @@ struct linenoiseState {
     size_t oldrows;     /* Rows used by last refrehsed line (multiline mode) */
     int oldrpos;        /* Cursor row from last refresh (for multiline clearing). */
     int history_index;  /* The history index we are currently editing. */
+    int in_search;      /* The user pressed Ctrl-R and we are now in reverse
+                         * search mode, so input is handled by searchLine(). */
+    char search[64];    /* Reverse search query. */
+    size_t search_len;  /* Reverse search query length. */
+    char search_prompt[96];   /* Prompt shown while searching. */
+    const char *saved_prompt; /* Prompt to restore after the search. */
+    unsigned int search_id;   /* Id of the matched history entry, 0 if none. */
+    int search_index;         /* History index of the match, 0 if none. */
+    char *render;             /* Output buffer of the refreshes, kept between them. */
+    int render_size;          /* Bytes allocated for 'render'. */
+    char *frame[2];           /* Last frame drawn in single line mode, and the next one. */
+    int frame_size[2];        /* Bytes allocated for each frame. */
+    int frame_len;            /* Bytes of frame[0]: the prompt and the visible text. */
+    int frame_cursor;         /* Cursor column in frame[0], -1 to redraw the line in full. */
+    size_t pwidth;            /* Display width of the prompt. */
+    size_t poscol;            /* Display width of buf up to pos. */
+    size_t lencol;            /* Display width of buf. */
+    size_t scroll;            /* Offset in buf of the first char shown, in single line mode. */
+    size_t scrollcol;         /* Display width of buf up to scroll. */
+    int widths;               /* The widths above match buf, 0 to measure them again. */
+    int batching;             /* Decoding queued keys: refreshes wait for the last one. */
+    int refresh_pending;      /* A refresh was put off while batching. */
+    struct linenoiseCompletionRequest *completion_req; /* Completions of the Tab cycle. */
 };
 
 typedef struct linenoiseCompletions {
@@ -78,6 +101,8 @@ typedef struct linenoiseCompletions {
 int linenoiseEditStart(struct linenoiseState *l, int stdin_fd, int stdout_fd, char *buf, size_t buflen, const char *prompt);
 char *linenoiseEditFeed(struct linenoiseState *l);
 void linenoiseEditStop(struct linenoiseState *l);
+void linenoiseEditResize(struct linenoiseState *l);
+int linenoiseEditPending(void);
 void linenoiseHide(struct linenoiseState *l);
 void linenoiseShow(struct linenoiseState *l);
 
@@ -93,15 +118,22 @@ void linenoiseSetCompletionCallback(linenoiseCompletionCallback *);
 void linenoiseSetHintsCallback(linenoiseHintsCallback *);
 void linenoiseSetFreeHintsCallback(linenoiseFreeHintsCallback *);
 void linenoiseAddCompletion(linenoiseCompletions *, const char *);
+int linenoiseCompletionCancelled(const linenoiseCompletions *);
+void linenoiseSetCompletionAsync(int async);
+int linenoiseCompletionFd(void);
 
 /* History API. */
 int linenoiseHistoryAdd(const char *line);
 int linenoiseHistorySetMaxLen(int len);
+void linenoiseHistorySetDedup(int dedup);
 int linenoiseHistorySave(const char *filename);
+int linenoiseHistoryAppend(const char *filename, const char *line);
+int linenoiseHistoryCompact(const char *filename);
 int linenoiseHistoryLoad(const char *filename);
 
 /* Other utilities. */
 void linenoiseClearScreen(void);
+void linenoiseWindowChanged(void);
 void linenoiseSetMultiLine(int ml);
 void linenoisePrintKeyCodes(void);
 void linenoiseMaskModeEnable(void);
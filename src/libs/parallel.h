@@ -0,0 +1,22 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_PARALLEL_H
+#define NSH_PARALLEL_H
+
+// The parallel builtin: parallel [-j N] command [args...] [::: arg...]
+//
+// Runs 'command' once per argument, up to N at a time (the number of online
+// CPUs by default). A "{}" in the command is replaced by the argument,
+// otherwise it is appended. Without ":::" the arguments are the lines of
+// stdin. The output of each run is kept together and printed once it ends,
+// followed by its exit status and run time on stderr. Returns the number of
+// runs that failed (at most 100), or 130 if interrupted.
+int parallel_run(int argc, char **argv);
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_PARSER_H
+#define NSH_PARSER_H
+
+#define PARSE_ERROR -1       /* Malformed line, e.g. an unterminated quote */
+#define PARSE_UNSUPPORTED -2 /* Valid shell syntax that nsh cannot run */
+
+#define REDIRECT_IN 0     /* [n]<file */
+#define REDIRECT_OUT 1    /* [n]>file */
+#define REDIRECT_APPEND 2 /* [n]>>file */
+#define REDIRECT_DUP 3    /* [n]>&m */
+
+/* A redirection of one of the command's file descriptors. */
+struct redirect {
+    int type;
+    int fd;     /* Descriptor of the command being redirected */
+    int dup_fd; /* REDIRECT_DUP: 'fd' becomes a copy of this one */
+    char *path; /* The file for the other types, points into the words */
+};
+
+/* One command of a pipeline, split into words with quotes removed and
+ * variables expanded. Its redirections apply in order, after the pipes. */
+struct command {
+    int argc;
+    char **argv; /* NULL-terminated, points into the pipeline's words */
+    int redirect_count;
+    struct redirect *redirects;
+};
+
+/* A command line: one or more commands connected by '|'. */
+struct pipeline {
+    int count;
+    struct command *commands;
+    int background;             /* Ended with '&' */
+    const char *line;           /* The line it was parsed from */
+    char **argvs;               /* Storage for the argv arrays */
+    struct redirect *redirects; /* Storage for the redirections */
+    char *words;                /* Storage for the words */
+    const char *error;          /* Reason for PARSE_ERROR / PARSE_UNSUPPORTED */
+};
+
+// Split 'line' into commands and words. Handles '|', a final '&', the
+// redirections <, >, >>, >&, &> and &>> (with an optional descriptor 0-9
+// in front), '...' and "..." quoting, backslash escapes, # comments and
+// $VAR, ${VAR}, $0-$9, $#, $@, $*, $? and $! expansion. Returns the number
+// of commands (0 for a line with nothing to run), PARSE_ERROR or
+// PARSE_UNSUPPORTED. The pipeline must be released with free_pipeline() in
+// every case.
+int parse_pipeline(const char *line, struct pipeline *pl);
+void free_pipeline(struct pipeline *pl);
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_PATH_HASH_H
+#define NSH_PATH_HASH_H
+
+/* Command hash table, in the spirit of bash's `hash`. Command names are
+ * resolved against $PATH once and remembered; an entry is dropped again
+ * when $PATH changes or when the modification time of one of the $PATH
+ * directories searched to find it changes. */
+
+// Resolve 'name' to the path of an executable. Names containing a '/' are
+// returned as-is. Returns NULL (errno = ENOENT) if nothing was found.
+const char *path_hash_lookup(const char *name);
+
+// Resolve 'name' and remember it without counting a hit. Returns 0 on
+// success, -1 if the command was not found.
+int path_hash_add(const char *name);
+
+// Forget every remembered command.
+void path_hash_reset(void);
+
+// Print the remembered commands and their hit counts.
+void path_hash_print(void);
+
+#endif
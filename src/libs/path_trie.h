@@ -0,0 +1,29 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_PATH_TRIE_H
+#define NSH_PATH_TRIE_H
+
+#include <stddef.h>
+
+/* Names of the executables on $PATH, kept in a prefix trie for tab
+ * completion. Each $PATH directory is read once with getdents64() and read
+ * again only when its modification time changes, so completing a command
+ * name costs a stat() per directory plus a walk of the matching subtree. */
+
+// Call 'add' with every executable in 'path', a copy of $PATH (NULL for the
+// default one), whose name starts with 'prefix', in sorted order and without
+// duplicates. Names starting with a '.' are only reported when 'prefix'
+// starts with one. Returns the number of names.
+size_t path_trie_complete(const char *path, const char *prefix,
+                          void (*add)(const char *name, void *arg), void *arg);
+
+// Forget every directory read so far.
+void path_trie_reset(void);
+
+#endif
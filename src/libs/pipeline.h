@@ -0,0 +1,20 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_PIPELINE_H
+#define NSH_PIPELINE_H
+
+#include "parser.h"
+
+// Run a parsed command line. The commands of a pipeline all start before
+// any of them is waited for, connected by pipes, as one job. Returns the
+// exit status of the last command, which also becomes $?, or 0 for a job
+// started in the background.
+int run_pipeline(struct pipeline *pl);
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#ifndef NSH_SCRIPT_H
+#define NSH_SCRIPT_H
+
+#define SCRIPT_FALLBACK -2 /* The script needs a real shell */
+
+// Run the script at 'path' inside nsh, feeding its lines through the same
+// parser and dispatcher as the REPL. The script runs like a subshell: its
+// working directory and environment changes are undone when it ends.
+// Scripts with a foreign interpreter (#!/usr/bin/python...) are executed
+// directly. Returns the exit status, or SCRIPT_FALLBACK if the script uses
+// syntax nsh does not support.
+int script_run(const char *path, char **args);
+
+// Whether a script is currently being interpreted
+int script_running(void);
+
+// Make the running script stop with 'status' after the current command
+void script_exit(int status);
+
+// Positional parameters of the running script: $0 and $1..$N. Outside a
+// script $0 is "nsh" and there are no arguments. Missing ones are "".
+const char *script_arg(int n);
+int script_arg_count(void);
+
+#endif
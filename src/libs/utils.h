@@ -32,8 +32,18 @@
 /* Reset / default */
 #define NSH_RESET "\033[0m"
 
+struct launch_options;
+
 void banner(void);
 void completion(const char *buff, linenoiseCompletions *lc);
-int parse_command(char *line, char **argv, int max_args);
-void execute_external(char **argv);
+void completion_prepare(void);
+void completion_reset(void);
+int last_exit_status(void);
+void set_last_exit_status(int status);
+int color_output(void);
+int is_script_file(const char *path);
+const char *command_path(const char *name);
+int execute_command(int argc, char **argv);
+pid_t launch_command(char **argv, const struct launch_options *opts);
+int execute_external(char **argv);
 int execute_script(const char *script_path, char **args);
\ No newline at end of file
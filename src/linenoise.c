@@ -103,21 +103,37 @@
  *
  */
 
+#define _GNU_SOURCE /* memrchr(), pipe2() */
 #include "libs/linenoise.h"
+#include "libs/linenoise_width.h"
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define LINENOISE_DEFAULT_HISTORY_MAX_LEN 100
 #define LINENOISE_MAX_LINE 4096
+#define LINENOISE_NEWLINE_MARK "\xe2\x86\xb5" /* How a newline in the line is shown: U+21B5 */
+#define LINENOISE_PASTE_ON "\x1b[?2004h"
+#define LINENOISE_PASTE_OFF "\x1b[?2004l"
+#define LINENOISE_RENDER_MIN 256 /* First size of the render buffer. */
+#define LINENOISE_COMPACT_MIN_SIZE 4096
 static char *unsupported_term[] = {"dumb", "cons25", "emacs", NULL};
 static linenoiseCompletionCallback *completionCallback = NULL;
 static linenoiseHintsCallback *hintsCallback = NULL;
@@ -125,15 +141,89 @@ static linenoiseFreeHintsCallback *freeHintsCallback = NULL;
 static char *linenoiseNoTTY(void);
 static void refreshLineWithCompletion(struct linenoiseState *ls, linenoiseCompletions *lc, int flags);
 static void refreshLineWithFlags(struct linenoiseState *l, int flags);
+static const char *historyView(int index);
+static int historyDead(int index);
+static int historyPack(int cap);
+static int historyEditEntry(int index, const char *line);
+static void historyEndEdit(void);
+static int historySearch(const char *query, size_t qlen, uint32_t before, uint32_t *id);
 
 static struct termios orig_termios; /* In order to restore at exit.*/
 static int maskmode = 0;            /* Show "***" instead of input. For passwords. */
 static int rawmode = 0;             /* For atexit() function to check if restore is needed*/
 static int mlmode = 0;              /* Multi line mode. Default is single line. */
 static int atexit_registered = 0;   /* Register atexit just 1 time. */
+
+/* Keys read from the terminal and not decoded yet. One read() takes all
+ * that the terminal has, and linenoiseEditFeed() decodes the keys from
+ * here, stopping at the Enter that ends the line. The buffer outlives an
+ * edit, so keys typed ahead of that Enter are kept for the next one. */
+static char inputBuf[4096];
+static size_t inputPos = 0; /* Next byte to decode. */
+static size_t inputLen = 0; /* Bytes in inputBuf. */
+
+/* The history is a circular buffer of entries, oldest first. The strings
+ * themselves are packed into large chunks instead of being strdup()ed one
+ * by one; see the History section below. */
+struct historyChunk {
+    size_t used; /* Bytes of data[] handed out so far. */
+    size_t size; /* Bytes available in data[]. */
+    int live;    /* Entries still pointing into this chunk. */
+    char data[];
+};
+
+struct historyEntry {
+    char *str;                  /* Text of the entry, null terminated; NULL
+                                 * once removed, see historyRemove(). */
+    size_t len;                 /* Length of 'str'. */
+    struct historyChunk *chunk; /* Chunk holding 'str'. */
+    char *edit;                 /* Edited copy while browsing, or NULL. */
+    uint32_t id;                /* Increases with every entry added. */
+};
+
 static int history_max_len = LINENOISE_DEFAULT_HISTORY_MAX_LEN;
-static int history_len = 0;
-static char **history = NULL;
+static int history_len = 0;                       /* Entries, dead ones included. */
+static int history_dead = 0;                      /* Entries removed but not evicted. */
+static struct historyEntry *history = NULL;       /* Ring buffer. */
+static int history_cap = 0;                       /* Slots allocated in the ring. */
+static int history_start = 0;                     /* Slot of the oldest entry. */
+static struct historyChunk *history_chunk = NULL; /* Chunk being filled. */
+static char *history_scratch = NULL;              /* Line typed before browsing. */
+static int *history_edited = NULL;                /* Slots with an edit pending. */
+static int history_edited_len = 0;
+static int history_edited_cap = 0;
+static uint32_t history_next_id = 1;              /* Id of the next entry. */
+
+/* Index of the grams of one to three bytes used by the reverse history
+ * search, see the History search section below. */
+struct gramList {
+    uint32_t key;    /* The gram, 0 for an empty bucket. */
+    uint32_t len;    /* Ids in the list. */
+    uint32_t cap;    /* Ids allocated. */
+    uint32_t *ids;   /* Entry ids, oldest first. */
+};
+
+static struct gramList *search_index = NULL; /* Open addressing table. */
+static size_t search_index_size = 0;         /* Buckets, a power of two. */
+static size_t search_index_used = 0;         /* Buckets in use. */
+static size_t search_dead = 0;               /* Entries evicted since built. */
+static uint32_t search_next = 0;             /* Oldest entry not indexed yet. */
+static int searchIndexAdd(struct historyEntry *e);
+static void searchIndexFree(void);
+static void searchIndexIdle(int fd);
+
+/* Global deduplication of the history, see linenoiseHistorySetDedup(). */
+struct historyKey {
+    uint32_t id;   /* Id of the entry, 0 for an empty bucket. */
+    uint32_t hash; /* Hash of the entry text. */
+};
+
+static int history_dedup = 0;                  /* Drop older copies of a line. */
+static struct historyKey *history_set = NULL;  /* Open addressing table. */
+static size_t history_set_size = 0;            /* Buckets, a power of two. */
+static size_t history_set_used = 0;            /* Buckets in use. */
+static void historySetDelete(struct historyEntry *e);
+static void historySetFree(void);
 
 /* =========================== UTF-8 support ================================ */
 
@@ -209,13 +299,20 @@ static int isRegionalIndicator(uint32_t cp) {
     return cp >= 0x1F1E6 && cp <= 0x1F1FF;
 }
 
+/* Return the width class of a codepoint, from the table generated by
+ * tools/gen_width_table.py: 0 no width, 1 one column, 2 two columns, 3 no
+ * width and part of the character before it (combining marks and the
+ * like). Two lookups: the block of the codepoint, then its 2 bits. */
+static int utf8WidthClass(uint32_t cp) {
+    if (cp > 0x10FFFF)
+        return 1;
+    return (linenoiseWidthBlocks[linenoiseWidthIndex[cp >> 8]][(cp & 0xFF) >> 2] >>
+            ((cp & 3) * 2)) & 3;
+}
+
 /* Check if codepoint is a combining mark or other zero-width character. */
 static int isCombiningMark(uint32_t cp) {
-    return (cp >= 0x0300 && cp <= 0x036F) || /* Combining Diacriticals */
-           (cp >= 0x1AB0 && cp <= 0x1AFF) || /* Combining Diacriticals Extended */
-           (cp >= 0x1DC0 && cp <= 0x1DFF) || /* Combining Diacriticals Supplement */
-           (cp >= 0x20D0 && cp <= 0x20FF) || /* Combining Diacriticals for Symbols */
-           (cp >= 0xFE20 && cp <= 0xFE2F);   /* Combining Half Marks */
+    return utf8WidthClass(cp) == 3;
 }
 
 /* Check if codepoint extends the previous character (doesn't start a new grapheme). */
@@ -355,101 +452,120 @@ static size_t utf8NextCharLen(const char *buf, size_t pos, size_t len) {
     return total;
 }
 
-/* Return the display width of a Unicode codepoint. This is a heuristic
- * that works for most common cases:
+/* Return the display width of a Unicode codepoint, following the East
+ * Asian Width and emoji data of the table:
  * - Control chars and zero-width: 0 columns
- * - Grapheme-extending chars (VS, skin tone, ZWJ): 0 columns
- * - ASCII printable: 1 column
+ * - Grapheme-extending chars (VS, skin tone, combining marks): 0 columns
  * - Wide chars (CJK, emoji, fullwidth): 2 columns
- * - Everything else: 1 column
- *
- * This is not a full wcwidth() implementation, but a minimal heuristic
- * that handles emoji and CJK characters reasonably well. */
+ * - Everything else: 1 column */
 static int utf8CharWidth(uint32_t cp) {
-    /* Control characters and combining marks: zero width. */
-    if (cp < 32 || (cp >= 0x7F && cp < 0xA0))
-        return 0;
-    if (isCombiningMark(cp))
-        return 0;
-
-    /* Grapheme-extending characters: zero width.
-     * These modify the preceding character rather than taking space. */
-    if (isVariationSelector(cp))
-        return 0;
-    if (isSkinToneModifier(cp))
-        return 0;
-    if (isZWJ(cp))
-        return 0;
-
-    /* Wide character ranges - these display as 2 columns:
-     * - CJK Unified Ideographs and Extensions
-     * - Fullwidth forms
-     * - Various emoji ranges */
-    if (cp >= 0x1100 &&
-        (cp <= 0x115F ||                   /* Hangul Jamo */
-         cp == 0x2329 || cp == 0x232A ||   /* Angle brackets */
-         (cp >= 0x231A && cp <= 0x231B) || /* Watch, Hourglass */
-         (cp >= 0x23E9 && cp <= 0x23F3) || /* Various symbols */
-         (cp >= 0x23F8 && cp <= 0x23FA) || /* Various symbols */
-         (cp >= 0x25AA && cp <= 0x25AB) || /* Small squares */
-         (cp >= 0x25B6 && cp <= 0x25C0) || /* Play/reverse buttons */
-         (cp >= 0x25FB && cp <= 0x25FE) || /* Squares */
-         (cp >= 0x2600 && cp <= 0x26FF) || /* Misc Symbols (sun, cloud, etc) */
-         (cp >= 0x2700 && cp <= 0x27BF) || /* Dingbats (❤, ✂, etc) */
-         (cp >= 0x2934 && cp <= 0x2935) || /* Arrows */
-         (cp >= 0x2B05 && cp <= 0x2B07) || /* Arrows */
-         (cp >= 0x2B1B && cp <= 0x2B1C) || /* Squares */
-         cp == 0x2B50 || cp == 0x2B55 ||   /* Star, circle */
-         (cp >= 0x2E80 && cp <= 0xA4CF &&
-          cp != 0x303F) ||                   /* CJK ... Yi */
-         (cp >= 0xAC00 && cp <= 0xD7A3) ||   /* Hangul Syllables */
-         (cp >= 0xF900 && cp <= 0xFAFF) ||   /* CJK Compatibility Ideographs */
-         (cp >= 0xFE10 && cp <= 0xFE1F) ||   /* Vertical forms */
-         (cp >= 0xFE30 && cp <= 0xFE6F) ||   /* CJK Compatibility Forms */
-         (cp >= 0xFF00 && cp <= 0xFF60) ||   /* Fullwidth Forms */
-         (cp >= 0xFFE0 && cp <= 0xFFE6) ||   /* Fullwidth Signs */
-         (cp >= 0x1F1E6 && cp <= 0x1F1FF) || /* Regional Indicators (flags) */
-         (cp >= 0x1F300 && cp <= 0x1F64F) || /* Misc Symbols and Emoticons */
-         (cp >= 0x1F680 && cp <= 0x1F6FF) || /* Transport and Map Symbols */
-         (cp >= 0x1F900 && cp <= 0x1F9FF) || /* Supplemental Symbols */
-         (cp >= 0x1FA00 && cp <= 0x1FAFF) || /* Chess, Extended-A */
-         (cp >= 0x20000 && cp <= 0x2FFFF)))  /* CJK Extension B and beyond */
-        return 2;
-
-    return 1; /* Default: single width */
+    int class;
+
+    /* ASCII: printable chars take one column, controls none, but for the
+     * newline that a paste can insert, shown as LINENOISE_NEWLINE_MARK. */
+    if (cp < 0x80)
+        return (cp >= 32 && cp != 0x7F) || cp == '\n';
+    class = utf8WidthClass(cp);
+    return class == 3 ? 0 : class;
+}
+
+/* Return the length of the run of ASCII bytes at the start of 's', adding
+ * its display width to '*width'. Runs are checked 16 bytes at a time with
+ * SSE2, or 8 bytes at a time in a 64 bit word elsewhere. */
+static size_t asciiRunWidth(const char *s, size_t len, size_t *width) {
+    size_t i = 0, w = 0;
+
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(32), del = _mm_set1_epi8(0x7F);
+    const __m128i nl = _mm_set1_epi8('\n');
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        int controls;
+
+        if (_mm_movemask_epi8(v))
+            break; /* Not all ASCII */
+        controls = _mm_movemask_epi8(
+            _mm_andnot_si128(_mm_cmpeq_epi8(v, nl),
+                             _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del))));
+        w += 16 - __builtin_popcount(controls);
+    }
+#else
+    const uint64_t high = 0x8080808080808080ULL, low = 0x7F7F7F7F7F7F7F7FULL;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v, nl;
+
+        memcpy(&v, s + i, 8);
+        if (v & high)
+            break; /* Not all ASCII */
+        /* With bytes below 0x80 nothing carries over: the high bit of
+         * each byte tells if it is at least 32, and if it is not DEL
+         * (or, in 'nl', if it is a newline). */
+        nl = v ^ 0x0A0A0A0A0A0A0A0AULL;
+        w += __builtin_popcountll((v + 0x6060606060606060ULL) & ((v ^ low) + low) & high);
+        w += __builtin_popcountll(~(nl + low) & high);
+    }
+#endif
+    for (; i < len && !(s[i] & 0x80); i++)
+        w += ((unsigned char)s[i] >= 32 && s[i] != 0x7F) || s[i] == '\n';
+    *width += w;
+    return i;
 }
 
 /* Calculate the display width of a UTF-8 string of 'len' bytes.
  * This is used for cursor positioning in the terminal.
  * Handles grapheme clusters: characters joined by ZWJ contribute 0 width
- * after the first character in the sequence. */
-static size_t utf8StrWidth(const char *s, size_t len) {
+ * after the first character in the sequence, 'after_zwj' tells if the
+ * string starts after one. Runs of ASCII, most of a command line, are
+ * counted in bulk. */
+static size_t utf8StrWidthJoined(const char *s, size_t len, int after_zwj) {
+    static const unsigned char classWidth[4] = {0, 1, 2, 0};
     size_t width = 0;
     size_t i = 0;
-    int after_zwj = 0; /* Track if previous char was ZWJ */
 
     while (i < len) {
         size_t clen;
-        uint32_t cp = utf8DecodeChar(s + i, &clen);
+        uint32_t cp;
 
-        if (after_zwj) {
-            /* Character after ZWJ: don't add width, it's joined.
-             * But do check for extending chars after it. */
-            after_zwj = 0;
-        } else {
-            width += utf8CharWidth(cp);
+        if (!after_zwj && !(s[i] & 0x80)) {
+            i += asciiRunWidth(s + i, len - i, &width);
+            continue;
         }
-
-        /* Check if this is a ZWJ - next char will be joined. */
-        if (isZWJ(cp)) {
-            after_zwj = 1;
+        /* Runs of 3 byte characters, such as CJK text, decoded in line. */
+        while (i + 3 <= len && ((unsigned char)s[i] & 0xF0) == 0xE0) {
+            cp = ((s[i] & 0x0F) << 12) | ((s[i + 1] & 0x3F) << 6) | (s[i + 2] & 0x3F);
+            i += 3;
+            if (!after_zwj)
+                width += classWidth[utf8WidthClass(cp)];
+            after_zwj = isZWJ(cp);
         }
-
+        if (i >= len)
+            break;
+        cp = utf8DecodeChar(s + i, &clen);
         i += clen;
+
+        /* Character after ZWJ: don't add width, it's joined. */
+        if (!after_zwj)
+            width += cp < 0x80 ? utf8CharWidth(cp) : classWidth[utf8WidthClass(cp)];
+        after_zwj = isZWJ(cp);
     }
     return width;
 }
 
+static size_t utf8StrWidth(const char *s, size_t len) {
+    return utf8StrWidthJoined(s, len, 0);
+}
+
+/* Display width of buf[from, to) as a part of the whole buffer: when the
+ * character before 'from' is a ZWJ, the first one is joined to it. */
+static size_t utf8SpanWidth(const char *buf, size_t from, size_t to) {
+    size_t cplen;
+    int joined = from > 0 && isZWJ(utf8DecodePrev(buf, from, &cplen));
+
+    return utf8StrWidthJoined(buf + from, to - from, joined);
+}
+
 /* Return the display width of a single UTF-8 character at position 's'. */
 static int utf8SingleCharWidth(const char *s, size_t len) {
     if (len == 0)
@@ -467,13 +583,16 @@ enum KEY_ACTION {
     CTRL_D = 4,     /* Ctrl-d */
     CTRL_E = 5,     /* Ctrl-e */
     CTRL_F = 6,     /* Ctrl-f */
+    CTRL_G = 7,     /* Ctrl-g */
     CTRL_H = 8,     /* Ctrl-h */
     TAB = 9,        /* Tab */
+    CTRL_J = 10,    /* Ctrl-j, or Enter typed ahead before raw mode */
     CTRL_K = 11,    /* Ctrl+k */
     CTRL_L = 12,    /* Ctrl+l */
     ENTER = 13,     /* Enter */
     CTRL_N = 14,    /* Ctrl-n */
     CTRL_P = 16,    /* Ctrl-p */
+    CTRL_R = 18,    /* Ctrl-r */
     CTRL_T = 20,    /* Ctrl-t */
     CTRL_U = 21,    /* Ctrl+u */
     CTRL_W = 23,    /* Ctrl+w */
@@ -541,6 +660,39 @@ static int isUnsupportedTerm(void) {
     return 0;
 }
 
+/* Number of bytes read from the terminal and not decoded yet. */
+static size_t inputPending(void) {
+    return inputLen - inputPos;
+}
+
+/* Tell if the terminal has input that can be read without waiting. */
+static int inputReady(int fd) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) == 1;
+}
+
+/* Tell if more keys can be handled without waiting. The terminal is only
+ * polled once the buffer is empty, that is once per read(). */
+static int inputQueued(int fd) {
+    return inputPending() || inputReady(fd);
+}
+
+/* Get the next byte of input in 'c', reading from the terminal only when
+ * all was decoded: then as much as it has is read at once. Returns 1, or
+ * what read() returned (0 at end of file, -1 on error). */
+static int inputByte(int fd, char *c) {
+    if (inputPos == inputLen) {
+        ssize_t nread = read(fd, inputBuf, sizeof(inputBuf));
+
+        if (nread <= 0)
+            return nread == 0 ? 0 : -1;
+        inputPos = 0;
+        inputLen = nread;
+    }
+    *c = inputBuf[inputPos++];
+    return 1;
+}
+
 /* Raw mode: 1960 magic shit. */
 static int enableRawMode(int fd) {
     struct termios raw;
@@ -577,8 +729,9 @@ static int enableRawMode(int fd) {
     raw.c_cc[VMIN] = 1;
     raw.c_cc[VTIME] = 0; /* 1 byte, no timer */
 
-    /* put terminal in raw mode after flushing */
-    if (tcsetattr(fd, TCSAFLUSH, &raw) < 0)
+    /* put terminal in raw mode after pending output. Keys typed ahead
+     * while a command was running are kept, not flushed. */
+    if (tcsetattr(fd, TCSADRAIN, &raw) < 0)
         goto fatal;
     rawmode = 1;
     return 0;
@@ -595,7 +748,7 @@ static void disableRawMode(int fd) {
         return;
     }
     /* Don't even check the return value as it's too late. */
-    if (rawmode && tcsetattr(fd, TCSAFLUSH, &orig_termios) != -1)
+    if (rawmode && tcsetattr(fd, TCSADRAIN, &orig_termios) != -1)
         rawmode = 0;
 }
 
@@ -629,8 +782,47 @@ static int getCursorPosition(int ifd, int ofd) {
     return cols;
 }
 
-/* Try to get the number of columns in the current terminal, or assume 80
- * if it fails. */
+/* Ask the terminal itself for its number of columns, moving the cursor to
+ * the right margin and back. Returns -1 if it does not answer. */
+static int probeColumns(int ifd, int ofd) {
+    int start, cols;
+
+    /* Get the initial position so we can restore it later. */
+    start = getCursorPosition(ifd, ofd);
+    if (start == -1)
+        return -1;
+
+    /* Go to right margin and get position. */
+    if (write(ofd, "\x1b[999C", 6) != 6)
+        return -1;
+    cols = getCursorPosition(ifd, ofd);
+    if (cols == -1)
+        return -1;
+
+    /* Restore position. */
+    if (cols > start) {
+        char seq[32];
+        snprintf(seq, 32, "\x1b[%dD", cols - start);
+        if (write(ofd, seq, strlen(seq)) == -1) {
+            /* Can't recover... */
+        }
+    }
+    return cols;
+}
+
+/* The width of the terminal is kept from one line to the next, and only
+ * asked again after the window changed. The escape sequence probe, a round
+ * trip to the terminal, runs at most once: when the ioctl() cannot tell. */
+static size_t cachedCols = 0;
+static volatile sig_atomic_t colsChanged = 0;
+
+static void sigwinchHandler(int sig) {
+    (void)sig;
+    linenoiseWindowChanged();
+}
+
+/* Get the number of columns in the current terminal, or assume 80 if it
+ * cannot be found. */
 static int getColumns(int ifd, int ofd) {
     struct winsize ws;
 
@@ -639,37 +831,41 @@ static int getColumns(int ifd, int ofd) {
     if (cols_env)
         return atoi(cols_env);
 
-    if (ioctl(1, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
-        /* ioctl() failed. Try to query the terminal itself. */
-        int start, cols;
-
-        /* Get the initial position so we can restore it later. */
-        start = getCursorPosition(ifd, ofd);
-        if (start == -1)
-            goto failed;
-
-        /* Go to right margin and get position. */
-        if (write(ofd, "\x1b[999C", 6) != 6)
-            goto failed;
-        cols = getCursorPosition(ifd, ofd);
-        if (cols == -1)
-            goto failed;
-
-        /* Restore position. */
-        if (cols > start) {
-            char seq[32];
-            snprintf(seq, 32, "\x1b[%dD", cols - start);
-            if (write(ofd, seq, strlen(seq)) == -1) {
-                /* Can't recover... */
-            }
-        }
-        return cols;
-    } else {
-        return ws.ws_col;
+    if (cachedCols && !colsChanged)
+        return cachedCols;
+    colsChanged = 0;
+    if (ioctl(ofd, TIOCGWINSZ, &ws) != -1 && ws.ws_col != 0) {
+        cachedCols = ws.ws_col;
+    } else if (cachedCols == 0) {
+        int cols = probeColumns(ifd, ofd);
+        cachedCols = cols > 0 ? cols : 80;
     }
+    return cachedCols;
+}
 
-failed:
-    return 80;
+/* Note that the terminal was resized. Safe to call from a signal handler:
+ * the width is read again by the next linenoiseEditStart(), or by
+ * linenoiseEditResize() during an edit. linenoise catches SIGWINCH itself,
+ * unless the program handles it (or blocks it, e.g. for a signalfd), in
+ * which case the program should call this. */
+void linenoiseWindowChanged(void) {
+    colsChanged = 1;
+}
+
+/* Catch SIGWINCH, if the program left it to its default action. */
+static void installWinchHandler(void) {
+    static int installed = 0;
+    struct sigaction sa;
+
+    if (installed)
+        return;
+    installed = 1;
+    if (sigaction(SIGWINCH, NULL, &sa) == 0 && sa.sa_handler == SIG_DFL) {
+        sa.sa_handler = sigwinchHandler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGWINCH, &sa, NULL);
+    }
 }
 
 /* Clear the screen. Used to handle ctrl+l */
@@ -688,6 +884,41 @@ static void linenoiseBeep(void) {
 
 /* ============================== Completion ================================ */
 
+/* Each Tab cycle gets a request, kept in linenoiseState until the cycle
+ * ends or the line is no longer the one it was made for: the completion
+ * callback is called once for the cycle, not for every Tab and redraw.
+ *
+ * By default the callback fills the table of the request at once. With
+ * linenoiseSetCompletionAsync(1) it runs on a worker thread instead, so a
+ * slow one (a directory on a network file system...) does not stop the
+ * editing: the table grows while the callback runs, and the editor shows
+ * and cycles through what is there so far. The worker writes a byte to completionPipe when it added
+ * completions or finished; the editor handles them in linenoiseEditFeed().
+ * Leaving the Tab cycle cancels the request: the completions added after
+ * that are dropped, and linenoiseCompletionCancelled() tells the callback
+ * it may stop. The table and the flags below are shared with the worker and
+ * only used under completionLock, which is never held for long. */
+struct linenoiseCompletionRequest {
+    linenoiseCompletions lc;          /* Completions found so far. */
+    linenoiseCompletionCallback *fn;  /* Callback producing them. */
+    char *buf;                        /* Line being completed. */
+    int done;                         /* The callback returned. */
+    int cancelled;                    /* The editor no longer wants it. */
+    int refs;                         /* Held by the editor and by the worker, if any. */
+    size_t shown;                     /* Completions the editor took into account. */
+};
+
+#define LINENOISE_COMPLETION_WAIT 50 /* Milliseconds a Tab waits for the first completion. */
+
+static int completionAsync = 0;
+static int completionPipe[2] = {-1, -1};
+static int completionWoken = 0;        /* A byte waits in completionPipe. */
+static int completionThreadStarted = 0;
+static pthread_mutex_t completionLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t completionCond = PTHREAD_COND_INITIALIZER;
+static struct linenoiseCompletionRequest *completionQueued = NULL; /* Next one for the worker. */
+static __thread struct linenoiseCompletionRequest *completionRunning = NULL; /* Worker's one. */
+
 /* Free a list of completion option populated by linenoiseAddCompletion(). */
 static void freeCompletions(linenoiseCompletions *lc) {
     size_t i;
@@ -697,18 +928,206 @@ static void freeCompletions(linenoiseCompletions *lc) {
         free(lc->cvec);
 }
 
+/* Drop a reference to a request, freeing it with the last one. Called with
+ * completionLock held. */
+static void completionRelease(struct linenoiseCompletionRequest *req) {
+    if (--req->refs > 0)
+        return;
+    freeCompletions(&req->lc);
+    free(req->buf);
+    free(req);
+}
+
+/* Tell the editor there is news about its request. Called with
+ * completionLock held. */
+static void completionWake(struct linenoiseCompletionRequest *req) {
+    if (req->cancelled || completionWoken)
+        return;
+    if (write(completionPipe[1], "", 1) == 1)
+        completionWoken = 1;
+}
+
+/* Read the wake up byte, if any. Returns 1 if there was one. */
+static int completionDrain(void) {
+    char junk[16];
+    int woken;
+
+    pthread_mutex_lock(&completionLock);
+    woken = completionWoken;
+    completionWoken = 0;
+    if (woken)
+        while (read(completionPipe[0], junk, sizeof(junk)) > 0) {
+        }
+    pthread_mutex_unlock(&completionLock);
+    return woken;
+}
+
+static void *completionWorker(void *arg) {
+    struct linenoiseCompletionRequest *req;
+    int cancelled;
+
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&completionLock);
+        while (completionQueued == NULL)
+            pthread_cond_wait(&completionCond, &completionLock);
+        req = completionQueued;
+        completionQueued = NULL;
+        cancelled = req->cancelled;
+        pthread_mutex_unlock(&completionLock);
+
+        if (!cancelled) {
+            completionRunning = req;
+            req->fn(req->buf, &req->lc);
+            completionRunning = NULL;
+        }
+
+        pthread_mutex_lock(&completionLock);
+        req->done = 1;
+        completionWake(req);
+        completionRelease(req);
+        pthread_mutex_unlock(&completionLock);
+    }
+    return NULL;
+}
+
+/* Start the worker the first time it is needed. Returns -1 if it cannot
+ * be started. */
+static int completionThreadStart(void) {
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t all, old;
+    int err;
+
+    if (completionThreadStarted)
+        return 0;
+    /* Signals are for the thread that edits, not for the worker. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&thread, &attr, completionWorker, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0)
+        return -1;
+    completionThreadStarted = 1;
+    return 0;
+}
+
+/* Make the request of a Tab cycle for 'buf'. Its table is filled here, or
+ * handed to the worker in the background mode. Returns NULL when out of
+ * memory. */
+static struct linenoiseCompletionRequest *completionStart(const char *buf) {
+    struct linenoiseCompletionRequest *req;
+
+    req = calloc(1, sizeof(*req));
+    if (req == NULL)
+        return NULL;
+    req->buf = strdup(buf);
+    if (req->buf == NULL) {
+        free(req);
+        return NULL;
+    }
+    req->fn = completionCallback;
+    req->refs = 1;
+
+    if (!completionAsync || completionThreadStart() == -1) {
+        req->fn(req->buf, &req->lc);
+        req->done = 1;
+        return req;
+    }
+
+    req->refs = 2;
+    pthread_mutex_lock(&completionLock);
+    if (completionQueued != NULL) /* Superseded before it started. */
+        completionRelease(completionQueued);
+    completionQueued = req;
+    pthread_cond_signal(&completionCond);
+    pthread_mutex_unlock(&completionLock);
+    return req;
+}
+
+/* Cancel the request of the current Tab cycle, if any. */
+static void completionStop(struct linenoiseState *ls) {
+    struct linenoiseCompletionRequest *req = ls->completion_req;
+
+    if (req == NULL)
+        return;
+    ls->completion_req = NULL;
+    pthread_mutex_lock(&completionLock);
+    req->cancelled = 1;
+    if (completionQueued == req) { /* The worker never saw it. */
+        completionQueued = NULL;
+        req->refs--;
+    }
+    completionRelease(req);
+    pthread_mutex_unlock(&completionLock);
+}
+
+/* Give a request that was just started a moment to find something, so a
+ * quick callback is shown by the Tab itself. A key ends the wait. */
+static void completionWait(struct linenoiseState *ls) {
+    struct linenoiseCompletionRequest *req = ls->completion_req;
+    struct pollfd fds[2] = {{ls->ifd, POLLIN, 0}, {completionPipe[0], POLLIN, 0}};
+    struct timespec start, now;
+    int ready, left;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        pthread_mutex_lock(&completionLock);
+        ready = req->done || req->lc.len > 0;
+        pthread_mutex_unlock(&completionLock);
+        if (ready || inputPending())
+            return;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left = LINENOISE_COMPLETION_WAIT - (int)((now.tv_sec - start.tv_sec) * 1000 +
+                                                 (now.tv_nsec - start.tv_nsec) / 1000000);
+        if (left <= 0 || poll(fds, 2, left) <= 0 || fds[0].revents)
+            return;
+        completionDrain();
+    }
+}
+
+/* Show what the worker found since the last time: the completion selected
+ * in the Tab cycle, if it was not there before, or a beep if there is
+ * nothing at all. */
+static void completionUpdate(struct linenoiseState *ls) {
+    struct linenoiseCompletionRequest *req = ls->completion_req;
+    int none;
+
+    if (req == NULL)
+        return;
+    pthread_mutex_lock(&completionLock);
+    none = req->done && req->lc.len == 0;
+    if (ls->completion_idx >= req->shown && ls->completion_idx < req->lc.len)
+        refreshLineWithCompletion(ls, &req->lc, REFRESH_ALL);
+    req->shown = req->lc.len;
+    pthread_mutex_unlock(&completionLock);
+    if (none) {
+        linenoiseBeep();
+        ls->in_completion = 0;
+        completionStop(ls);
+    }
+}
+
 /* Called by completeLine() and linenoiseShow() to render the current
  * edited line with the proposed completion. If the current completion table
  * is already available, it is passed as second argument, otherwise the
- * function will use the callback to obtain it.
+ * function uses the one of the Tab cycle.
  *
  * Flags are the same as refreshLine*(), that is REFRESH_* macros. */
 static void refreshLineWithCompletion(struct linenoiseState *ls, linenoiseCompletions *lc, int flags) {
     /* Obtain the table of completions if the caller didn't provide one. */
-    linenoiseCompletions ctable = {0, NULL};
+    struct linenoiseCompletionRequest *req = NULL;
     if (lc == NULL) {
-        completionCallback(ls->buf, &ctable);
-        lc = &ctable;
+        req = ls->completion_req;
+        if (req == NULL) {
+            refreshLineWithFlags(ls, flags);
+            return;
+        }
+        pthread_mutex_lock(&completionLock);
+        lc = &req->lc;
     }
 
     /* Show the edited line with completion if possible, or just refresh. */
@@ -716,17 +1135,25 @@ static void refreshLineWithCompletion(struct linenoiseState *ls, linenoiseComple
         struct linenoiseState saved = *ls;
         ls->len = ls->pos = strlen(lc->cvec[ls->completion_idx]);
         ls->buf = lc->cvec[ls->completion_idx];
+        ls->widths = 0;
         refreshLineWithFlags(ls, flags);
         ls->len = saved.len;
         ls->pos = saved.pos;
         ls->buf = saved.buf;
+        ls->poscol = saved.poscol;
+        ls->lencol = saved.lencol;
+        ls->scroll = saved.scroll;
+        ls->scrollcol = saved.scrollcol;
+        ls->widths = saved.widths;
     } else {
         refreshLineWithFlags(ls, flags);
     }
 
-    /* Free the completions table if needed. */
-    if (lc != &ctable)
-        freeCompletions(&ctable);
+    /* Let the worker go on. */
+    if (req != NULL) {
+        req->shown = lc->len;
+        pthread_mutex_unlock(&completionLock);
+    }
 }
 
 /* This is an helper function for linenoiseEdit*() and is called when the
@@ -744,12 +1171,32 @@ static void refreshLineWithCompletion(struct linenoiseState *ls, linenoiseComple
  * possible completions, and the caller should read for the next characters
  * from stdin. */
 static int completeLine(struct linenoiseState *ls, int keypressed) {
-    linenoiseCompletions lc = {0, NULL};
-    int nwritten;
+    struct linenoiseCompletionRequest *req;
+    linenoiseCompletions *lc;
+    size_t shown;
+    int nwritten, done;
     char c = keypressed;
 
-    completionCallback(ls->buf, &lc);
-    if (lc.len == 0) {
+    /* The whole Tab cycle uses one table, made again only if the line
+     * changed under it. */
+    if (ls->completion_req != NULL && strcmp(ls->completion_req->buf, ls->buf) != 0)
+        completionStop(ls);
+    if (ls->completion_req == NULL) {
+        ls->completion_req = completionStart(ls->buf);
+        if (ls->completion_req == NULL) {
+            linenoiseBeep();
+            ls->in_completion = 0;
+            return c;
+        }
+        completionWait(ls);
+    }
+    req = ls->completion_req;
+    pthread_mutex_lock(&completionLock);
+    lc = &req->lc;
+    done = req->done;
+    shown = req->shown;
+
+    if (lc->len == 0 && done) {
         linenoiseBeep();
         ls->in_completion = 0;
     } else {
@@ -759,39 +1206,44 @@ static int completeLine(struct linenoiseState *ls, int keypressed) {
                 ls->in_completion = 1;
                 ls->completion_idx = 0;
             } else {
-                ls->completion_idx = (ls->completion_idx + 1) % (lc.len + 1);
-                if (ls->completion_idx == lc.len)
+                ls->completion_idx = (ls->completion_idx + 1) % (lc->len + 1);
+                if (ls->completion_idx == lc->len && done)
                     linenoiseBeep();
             }
             c = 0;
             break;
         case 27: /* escape */
             /* Re-show original buffer */
-            if (ls->completion_idx < lc.len)
+            if (ls->completion_idx < shown)
                 refreshLine(ls);
             ls->in_completion = 0;
             c = 0;
             break;
         default:
-            /* Update buffer and return */
-            if (ls->completion_idx < lc.len) {
+            /* Update buffer and return, if a completion is shown: one
+             * found since the last refresh was not seen by the user. */
+            if (ls->completion_idx < shown) {
                 nwritten = snprintf(ls->buf, ls->buflen, "%s",
-                                    lc.cvec[ls->completion_idx]);
+                                    lc->cvec[ls->completion_idx]);
                 ls->len = ls->pos = nwritten;
+                ls->widths = 0;
             }
             ls->in_completion = 0;
             break;
         }
 
         /* Show completion or original buffer */
-        if (ls->in_completion && ls->completion_idx < lc.len) {
-            refreshLineWithCompletion(ls, &lc, REFRESH_ALL);
+        if (ls->in_completion && ls->completion_idx < lc->len) {
+            refreshLineWithCompletion(ls, lc, REFRESH_ALL);
         } else {
             refreshLine(ls);
         }
     }
 
-    freeCompletions(&lc);
+    req->shown = lc->len;
+    pthread_mutex_unlock(&completionLock);
+    if (!ls->in_completion)
+        completionStop(ls);
     return c; /* Return last read character */
 }
 
@@ -800,6 +1252,24 @@ void linenoiseSetCompletionCallback(linenoiseCompletionCallback *fn) {
     completionCallback = fn;
 }
 
+/* Run the completion callback on a worker thread, see completionStart().
+ * The callback must then be safe to call from another thread, and should
+ * stop early when linenoiseCompletionCancelled() says so. A program using
+ * the multiplexed API also waits for linenoiseCompletionFd(), so that
+ * completions found after the Tab was handled are shown at once. */
+void linenoiseSetCompletionAsync(int async) {
+    if (async && completionPipe[0] == -1 && pipe2(completionPipe, O_CLOEXEC | O_NONBLOCK) == -1)
+        return;
+    completionAsync = async;
+}
+
+/* Return a descriptor that is readable when completions found in the
+ * background wait for linenoiseEditFeed() to show them, or -1 when the
+ * completion callback is called by the editor itself. */
+int linenoiseCompletionFd(void) {
+    return completionAsync ? completionPipe[0] : -1;
+}
+
 /* Register a hits function to be called to show hits to the user at the
  * right of the prompt. */
 void linenoiseSetHintsCallback(linenoiseHintsCallback *fn) {
@@ -817,6 +1287,8 @@ void linenoiseSetFreeHintsCallback(linenoiseFreeHintsCallback *fn) {
  * user typed <tab>. See the example.c source code for a very easy to
  * understand example. */
 void linenoiseAddCompletion(linenoiseCompletions *lc, const char *str) {
+    struct linenoiseCompletionRequest *req = completionRunning;
+    int shared = req != NULL && lc == &req->lc;
     size_t len = strlen(str);
     char *copy, **cvec;
 
@@ -824,13 +1296,40 @@ void linenoiseAddCompletion(linenoiseCompletions *lc, const char *str) {
     if (copy == NULL)
         return;
     memcpy(copy, str, len + 1);
+    /* The table of a request is read by the editor at the same time. */
+    if (shared) {
+        pthread_mutex_lock(&completionLock);
+        if (req->cancelled) {
+            pthread_mutex_unlock(&completionLock);
+            free(copy);
+            return;
+        }
+    }
     cvec = realloc(lc->cvec, sizeof(char *) * (lc->len + 1));
     if (cvec == NULL) {
         free(copy);
-        return;
+    } else {
+        lc->cvec = cvec;
+        lc->cvec[lc->len++] = copy;
     }
-    lc->cvec = cvec;
-    lc->cvec[lc->len++] = copy;
+    if (shared) {
+        completionWake(req);
+        pthread_mutex_unlock(&completionLock);
+    }
+}
+
+/* Called by a completion callback running in the background to know if the
+ * user moved on, so that the completions it would add are not wanted. */
+int linenoiseCompletionCancelled(const linenoiseCompletions *lc) {
+    struct linenoiseCompletionRequest *req = completionRunning;
+    int cancelled;
+
+    if (req == NULL || lc != &req->lc)
+        return 0;
+    pthread_mutex_lock(&completionLock);
+    cancelled = req->cancelled;
+    pthread_mutex_unlock(&completionLock);
+    return cancelled;
 }
 
 /* =========================== Line editing ================================= */
@@ -838,36 +1337,339 @@ void linenoiseAddCompletion(linenoiseCompletions *lc, const char *str) {
 /* We define a very simple "append buffer" structure, that is an heap
  * allocated string where we can append to. This is useful in order to
  * write all the escape sequences in a buffer and flush them to the standard
- * output in a single call, to avoid flickering effects. */
+ * output in a single call, to avoid flickering effects.
+ *
+ * The memory belongs to the linenoiseState: it is taken back by abInit()
+ * and handed over again by abKeep() on every refresh, growing geometrically
+ * when a frame does not fit, so that once the line stops growing a refresh
+ * allocates nothing. It is freed by linenoiseEditStop(). */
 struct abuf {
     char *b;
     int len;
+    int cap;
 };
 
-static void abInit(struct abuf *ab) {
-    ab->b = NULL;
+static void abInit(struct abuf *ab, struct linenoiseState *l) {
+    ab->b = l->render;
     ab->len = 0;
+    ab->cap = l->render_size;
 }
 
 static void abAppend(struct abuf *ab, const char *s, int len) {
-    char *new = realloc(ab->b, ab->len + len);
+    if (ab->len + len > ab->cap) {
+        int cap = ab->cap ? ab->cap : LINENOISE_RENDER_MIN;
+        char *new;
 
-    if (new == NULL)
-        return;
-    memcpy(new + ab->len, s, len);
-    ab->b = new;
+        while (cap < ab->len + len)
+            cap *= 2;
+        new = realloc(ab->b, cap);
+        if (new == NULL)
+            return;
+        ab->b = new;
+        ab->cap = cap;
+    }
+    memcpy(ab->b + ab->len, s, len);
     ab->len += len;
 }
 
-static void abFree(struct abuf *ab) {
-    free(ab->b);
+/* Append text of the line, showing newlines as LINENOISE_NEWLINE_MARK. */
+static void abAppendText(struct abuf *ab, const char *s, int len) {
+    const char *nl;
+
+    while ((nl = memchr(s, '\n', len)) != NULL) {
+        abAppend(ab, s, nl - s);
+        abAppend(ab, LINENOISE_NEWLINE_MARK, sizeof(LINENOISE_NEWLINE_MARK) - 1);
+        len -= nl + 1 - s;
+        s = nl + 1;
+    }
+    abAppend(ab, s, len);
+}
+
+static void abKeep(struct abuf *ab, struct linenoiseState *l) {
+    l->render = ab->b;
+    l->render_size = ab->cap;
+}
+
+/* Differential redraw (single line mode).
+ *
+ * The state remembers the last frame drawn: the bytes of the prompt and of
+ * the visible part of the line, and the column of the cursor. A refresh
+ * builds the new frame next to it and only sends the span that changed,
+ * after moving the cursor there: the common prefix and suffix of the two
+ * frames stay on screen. When the change is an insertion or deletion in
+ * the middle of the line, the characters after it are shifted by the
+ * terminal (ICH / DCH) instead of being written again, if that is shorter.
+ * Anything else that draws on the line sets frame_cursor to -1, and the
+ * next refresh redraws it in full. */
+
+/* Make room for 'size' bytes in frame[i]. */
+static int frameReserve(struct linenoiseState *l, int i, int size) {
+    if (size > l->frame_size[i]) {
+        int cap = l->frame_size[i] ? l->frame_size[i] : LINENOISE_RENDER_MIN;
+        char *new;
+
+        while (cap < size)
+            cap *= 2;
+        new = realloc(l->frame[i], cap);
+        if (new == NULL)
+            return -1;
+        l->frame[i] = new;
+        l->frame_size[i] = cap;
+    }
+    return 0;
+}
+
+/* Build the frame for 'text' in frame[1], with newlines shown as
+ * LINENOISE_NEWLINE_MARK. Returns its length, or -1. */
+static int frameBuild(struct linenoiseState *l, const char *text, size_t len) {
+    const char *nl = memchr(text, '\n', len);
+    int flen = l->plen + len;
+    char *f;
+
+    while (nl != NULL) {
+        flen += sizeof(LINENOISE_NEWLINE_MARK) - 2;
+        nl = memchr(nl + 1, '\n', text + len - nl - 1);
+    }
+    if (frameReserve(l, 1, flen) == -1)
+        return -1;
+    memcpy(l->frame[1], l->prompt, l->plen);
+    f = l->frame[1] + l->plen;
+    while ((nl = memchr(text, '\n', len)) != NULL) {
+        memcpy(f, text, nl - text);
+        f += nl - text;
+        memcpy(f, LINENOISE_NEWLINE_MARK, sizeof(LINENOISE_NEWLINE_MARK) - 1);
+        f += sizeof(LINENOISE_NEWLINE_MARK) - 1;
+        len -= nl + 1 - text;
+        text = nl + 1;
+    }
+    memcpy(f, text, len);
+    return flen;
+}
+
+/* Make the frame in frame[1] the one on screen. */
+static void frameCommit(struct linenoiseState *l, int len, int cursor) {
+    char *b = l->frame[0];
+    int size = l->frame_size[0];
+
+    l->frame[0] = l->frame[1];
+    l->frame_size[0] = l->frame_size[1];
+    l->frame[1] = b;
+    l->frame_size[1] = size;
+    l->frame_len = len;
+    l->frame_cursor = cursor;
+}
+
+/* Record text written at the cursor, at the end of the frame. */
+static void frameAppend(struct linenoiseState *l, const char *s, size_t len, int width) {
+    if (l->frame_cursor < 0)
+        return;
+    if (frameReserve(l, 0, l->frame_len + len) == -1) {
+        l->frame_cursor = -1;
+        return;
+    }
+    memcpy(l->frame[0] + l->frame_len, s, len);
+    l->frame_len += len;
+    l->frame_cursor += width;
+}
+
+/* True if a difference may start (or end) at byte 'i' of 's': 'i' is the
+ * start of a character that takes room on screen, not a continuation
+ * byte, a combining mark or a character joined by a ZWJ. */
+static int frameBoundary(const char *s, int len, int i) {
+    if (i == len)
+        return 1;
+    if ((s[i] & 0xC0) == 0x80)
+        return 0;
+    if (i >= 3 && memcmp(s + i - 3, "\xe2\x80\x8d", 3) == 0)
+        return 0;
+    return utf8SingleCharWidth(s + i, len - i) > 0;
+}
+
+/* Move the cursor of the line from column 'from' to column 'to'. */
+static void abMoveCursor(struct abuf *ab, int from, int to, int cols) {
+    char seq[32];
+
+    /* Past the last column the cursor is waiting to wrap: go absolute. */
+    if (from >= cols && to != from) {
+        abAppend(ab, "\r", 1);
+        from = 0;
+    }
+    if (to == from)
+        return;
+    if (to == 0) {
+        abAppend(ab, "\r", 1);
+    } else if (to == from - 1) {
+        abAppend(ab, "\b", 1);
+    } else {
+        snprintf(seq, sizeof(seq), "\x1b[%d%c", to > from ? to - from : from - to,
+                 to > from ? 'C' : 'D');
+        abAppend(ab, seq, strlen(seq));
+    }
+}
+
+/* When the line scrolled horizontally, the text after byte 'p' of the
+ * frames is the same, only moved by a few characters: shift it with DCH
+ * (scrolled left) or ICH (scrolled right) and write the characters that
+ * came into view. Returns the column of the cursor after that, or -1 if
+ * the frames do not differ by such a shift, or if it would not be shorter
+ * than writing 'cost' bytes. */
+static int refreshShift(struct abuf *ab, struct linenoiseState *l, int newlen, int p, int col,
+                        int cost) {
+    const char *old = l->frame[0], *new = l->frame[1];
+    int oldlen = l->frame_len;
+    char seq[32];
+    int left, d, chars, rest, w, at;
+
+    for (left = 1; left >= 0; left--) {
+        /* Scrolled left, old[p+d..] starts the new text; scrolled right,
+         * new[p+d..] starts the old one. */
+        const char *a = left ? old : new, *b = left ? new : old;
+        int alen = left ? oldlen : newlen, blen = left ? newlen : oldlen;
+
+        for (d = p, chars = 0; d < alen && chars < 8; chars++) {
+            d += utf8NextCharLen(a, d, alen);
+            while (d < alen && !frameBoundary(a, alen, d))
+                d += utf8NextCharLen(a, d, alen);
+            rest = alen - d;
+            if (rest > blen - p || memcmp(a + d, b + p, rest) != 0 ||
+                !frameBoundary(b, blen, p + rest))
+                continue;
+            w = utf8StrWidth(a + p, d - p);
+            if ((left ? newlen - p - rest : d - p) + 16 >= cost)
+                return -1;
+
+            abMoveCursor(ab, l->frame_cursor, col, l->cols);
+            snprintf(seq, sizeof(seq), "\x1b[%d%c", w, left ? 'P' : '@');
+            abAppend(ab, seq, strlen(seq));
+            if (left) {
+                /* The new characters go after the shifted text. */
+                at = col + utf8StrWidth(old + d, rest);
+                abMoveCursor(ab, col, at, l->cols);
+                abAppend(ab, new + p + rest, newlen - p - rest);
+                at += utf8StrWidth(new + p + rest, newlen - p - rest);
+            } else {
+                /* The old characters pushed past the new end are erased. */
+                abAppend(ab, new + p, d - p);
+                at = col + utf8StrWidth(new + p, newlen - p);
+                if (rest < oldlen - p && at < (int)l->cols) {
+                    abMoveCursor(ab, col + w, at, l->cols);
+                    abAppend(ab, "\x1b[0K", 4);
+                } else {
+                    at = col + w;
+                }
+            }
+            return at;
+        }
+    }
+    return -1;
+}
+
+/* Draw the frame in frame[1] over the one on screen, sending only what
+ * changed, and leave the cursor at column 'cursor'. */
+static void refreshDiff(struct abuf *ab, struct linenoiseState *l, int newlen, int cursor) {
+    const char *old = l->frame[0], *new = l->frame[1];
+    int oldlen = l->frame_len;
+    int p = 0, s = 0, col, wold, wnew, tail, at;
+    char seq[32];
+
+    /* Common prefix and suffix, cut at character boundaries. */
+    while (p < oldlen && p < newlen && old[p] == new[p])
+        p++;
+    while (p > 0 && (!frameBoundary(old, oldlen, p) || !frameBoundary(new, newlen, p)))
+        p--;
+    while (s < oldlen - p && s < newlen - p && old[oldlen - 1 - s] == new[newlen - 1 - s])
+        s++;
+    while (s > 0 && (!frameBoundary(old, oldlen, oldlen - s) ||
+                     !frameBoundary(new, newlen, newlen - s)))
+        s--;
+
+    col = utf8StrWidth(new, p);
+    wold = utf8StrWidth(old + p, oldlen - s - p);
+    wnew = utf8StrWidth(new + p, newlen - s - p);
+    if (p == oldlen && p == newlen) {
+        abMoveCursor(ab, l->frame_cursor, cursor, l->cols);
+        return;
+    }
+    at = refreshShift(ab, l, newlen, p, col, s > 0 ? newlen - s - p + 4 : newlen - p);
+    if (at >= 0) {
+        abMoveCursor(ab, at, cursor, l->cols);
+        return;
+    }
+    abMoveCursor(ab, l->frame_cursor, col, l->cols);
+
+    /* Either write everything from the change on, and erase what is left
+     * of a longer old line, or write the changed span alone and let the
+     * terminal shift the rest of the line. */
+    tail = (s > 0 && wnew != wold)
+               ? snprintf(seq, sizeof(seq), "\x1b[%d%c", wnew > wold ? wnew - wold : wold - wnew,
+                          wnew > wold ? '@' : 'P')
+               : 0;
+    if (s > 0 && newlen - s - p + tail < newlen - p + (wnew < wold ? 4 : 0)) {
+        if (wnew > wold)
+            abAppend(ab, seq, tail);
+        abAppend(ab, new + p, newlen - s - p);
+        if (wnew < wold)
+            abAppend(ab, seq, tail);
+        at = col + wnew;
+    } else {
+        abAppend(ab, new + p, newlen - p);
+        if (wnew < wold)
+            abAppend(ab, "\x1b[0K", 4);
+        at = col + wnew + utf8StrWidth(new + newlen - s, s);
+    }
+    abMoveCursor(ab, at, cursor, l->cols);
+}
+
+/* Display widths of the line (single and multi line mode).
+ *
+ * The state keeps the display width of the buffer, of the part before the
+ * cursor and of the part scrolled out on the left, so that a refresh does
+ * not measure the whole line again. Inserting, deleting and moving the
+ * cursor update them by measuring only the characters they touch; any other
+ * change of the buffer sets l->widths to 0, and the next refresh measures
+ * the line once. */
+
+/* Measure the line, if a change did not keep the widths up to date. */
+static void widthsUpdate(struct linenoiseState *l) {
+    if (l->widths)
+        return;
+    l->poscol = utf8StrWidth(l->buf, l->pos);
+    l->lencol = l->poscol + utf8SpanWidth(l->buf, l->pos, l->len);
+    l->scroll = l->scrollcol = 0;
+    l->widths = 1;
+}
+
+/* Width of the part of the line that a change of buf[a, b) can affect:
+ * those bytes and the character after them, which a ZWJ would join. */
+static size_t widthsAround(struct linenoiseState *l, size_t a, size_t b) {
+    if (b < l->len) {
+        b += utf8ByteLen(l->buf[b]);
+        if (b > l->len)
+            b = l->len;
+    }
+    return utf8SpanWidth(l->buf, a, b);
+}
+
+/* Before replacing buf[a, b): returns what widthsEditEnd() needs. */
+static size_t widthsEditStart(struct linenoiseState *l, size_t a, size_t b) {
+    return l->widths ? widthsAround(l, a, b) : 0;
+}
+
+/* After replacing buf[a, b) with buf[a, c), 'before' being the value of
+ * widthsEditStart(). The caller updates poscol. */
+static void widthsEditEnd(struct linenoiseState *l, size_t a, size_t c, size_t before) {
+    if (!l->widths)
+        return;
+    l->lencol = l->lencol - before + widthsAround(l, a, c);
+    if (a < l->scroll)
+        l->scroll = l->scrollcol = 0;
 }
 
 /* Helper of refreshSingleLine() and refreshMultiLine() to show hints
  * to the right of the prompt. Now uses display widths for proper UTF-8. */
 void refreshShowHints(struct abuf *ab, struct linenoiseState *l, int pwidth) {
     char seq[64];
-    size_t bufwidth = utf8StrWidth(l->buf, l->len);
+    size_t bufwidth = l->lencol;
     if (hintsCallback && pwidth + bufwidth < l->cols) {
         int color = -1, bold = 0;
         char *hint = hintsCallback(l->buf, &color, &bold);
@@ -917,41 +1719,76 @@ void refreshShowHints(struct abuf *ab, struct linenoiseState *l, int pwidth) {
  * for cursor positioning and horizontal scrolling. */
 static void refreshSingleLine(struct linenoiseState *l, int flags) {
     char seq[64];
-    size_t pwidth = utf8StrWidth(l->prompt, l->plen); /* Prompt display width */
+    size_t pwidth = l->pwidth; /* Prompt display width */
     int fd = l->ofd;
-    char *buf = l->buf;
-    size_t len = l->len; /* Byte length of buffer to display */
-    size_t pos = l->pos; /* Byte position of cursor */
-    size_t poscol;       /* Display column of cursor */
-    size_t lencol;       /* Display width of buffer */
+    char *buf;
+    size_t len;    /* Byte length of buffer to display */
+    size_t poscol; /* Display column of cursor */
+    size_t lencol; /* Display width of buffer */
+    size_t need;
     struct abuf ab;
 
-    /* Calculate the display width up to cursor and total display width. */
-    poscol = utf8StrWidth(buf, pos);
-    lencol = utf8StrWidth(buf, len);
-
-    /* Scroll the buffer horizontally if cursor is past the right edge.
-     * We need to trim full UTF-8 characters from the left until the
-     * cursor position fits within the terminal width. */
-    while (pwidth + poscol >= l->cols) {
-        size_t clen = utf8NextCharLen(buf, 0, len);
-        int cwidth = utf8SingleCharWidth(buf, clen);
-        buf += clen;
-        len -= clen;
-        pos -= clen;
-        poscol -= cwidth;
-        lencol -= cwidth;
+    widthsUpdate(l);
+
+    /* Scroll the buffer horizontally if cursor is past the right edge:
+     * full UTF-8 characters are trimmed from the left until the cursor
+     * position fits within the terminal width. The start of the part shown
+     * moves from where the last refresh left it, so only the characters
+     * that scroll in or out are looked at. */
+    need = (pwidth + l->poscol >= l->cols) ? pwidth + l->poscol - l->cols + 1 : 0;
+    while (l->scroll > 0) {
+        size_t clen = utf8PrevCharLen(l->buf, l->scroll);
+        size_t cwidth = utf8SpanWidth(l->buf, l->scroll - clen, l->scroll);
+        if (l->scrollcol - cwidth < need)
+            break;
+        l->scroll -= clen;
+        l->scrollcol -= cwidth;
+    }
+    while (l->scrollcol < need && l->scroll < l->pos) {
+        /* A cursor inside a ZWJ sequence stays in view. */
+        size_t clen = utf8NextCharLen(l->buf, l->scroll, l->pos);
+        l->scrollcol += utf8SpanWidth(l->buf, l->scroll, l->scroll + clen);
+        l->scroll += clen;
     }
+    buf = l->buf + l->scroll;
+    len = l->len - l->scroll;
+    poscol = l->poscol - l->scrollcol;
+    lencol = l->lencol - l->scrollcol;
+
+    /* Trim from the right if the line still doesn't fit: keep the
+     * characters after the cursor that fit in the terminal width, leaving
+     * the last column free like the cursor does. Text written up to the
+     * edge leaves the terminal waiting to wrap, and the erase that ends a
+     * full redraw then clears the last column: the line drawn in full and
+     * the line updated by refreshDiff() would not look the same. */
+    if (pwidth + lencol >= l->cols) {
+        size_t end = l->pos;
+
+        lencol = poscol;
+        while (end < l->len) {
+            size_t clen = utf8NextCharLen(l->buf, end, l->len);
+            size_t cwidth = utf8SpanWidth(l->buf, end, end + clen);
+            if (pwidth + lencol + cwidth >= l->cols)
+                break;
+            end += clen;
+            lencol += cwidth;
+        }
+        len = end - l->scroll;
+    }
+
+    abInit(&ab, l);
 
-    /* Trim from the right if the line still doesn't fit. */
-    while (pwidth + lencol > l->cols) {
-        size_t clen = utf8PrevCharLen(buf, len);
-        int cwidth = utf8SingleCharWidth(buf + len - clen, clen);
-        len -= clen;
-        lencol -= cwidth;
+    /* Send only what changed, when the line on screen is known. */
+    if (flags == REFRESH_ALL && maskmode == 0 && !hintsCallback && l->frame_cursor >= 0) {
+        int flen = frameBuild(l, buf, len);
+        if (flen >= 0) {
+            refreshDiff(&ab, l, flen, pwidth + poscol);
+            frameCommit(l, flen, pwidth + poscol);
+            goto done;
+        }
     }
+    l->frame_cursor = -1;
 
-    abInit(&ab);
     /* Cursor to left edge */
     snprintf(seq, sizeof(seq), "\r");
     abAppend(&ab, seq, strlen(seq));
@@ -967,7 +1804,7 @@ static void refreshSingleLine(struct linenoiseState *l, int flags) {
                 i += utf8NextCharLen(buf, i, len);
             }
         } else {
-            abAppend(&ab, buf, len);
+            abAppendText(&ab, buf, len);
         }
         /* Show hints if any. */
         refreshShowHints(&ab, l, pwidth);
@@ -981,11 +1818,19 @@ static void refreshSingleLine(struct linenoiseState *l, int flags) {
         /* Move cursor to original position (using display column, not byte). */
         snprintf(seq, sizeof(seq), "\r\x1b[%dC", (int)(poscol + pwidth));
         abAppend(&ab, seq, strlen(seq));
+
+        /* The next refresh can start from this frame. */
+        if (maskmode == 0 && !hintsCallback) {
+            int flen = frameBuild(l, buf, len);
+            if (flen >= 0)
+                frameCommit(l, flen, pwidth + poscol);
+        }
     }
 
+done:
     if (write(fd, ab.b, ab.len) == -1) {
     } /* Can't recover from write error. */
-    abFree(&ab);
+    abKeep(&ab, l);
 }
 
 /* Multi line low level line refresh.
@@ -999,10 +1844,8 @@ static void refreshSingleLine(struct linenoiseState *l, int flags) {
  * This function is UTF-8 aware and uses display widths for positioning. */
 static void refreshMultiLine(struct linenoiseState *l, int flags) {
     char seq[64];
-    size_t pwidth = utf8StrWidth(l->prompt, l->plen);       /* Prompt display width */
-    size_t bufwidth = utf8StrWidth(l->buf, l->len);         /* Buffer display width */
-    size_t poswidth = utf8StrWidth(l->buf, l->pos);         /* Cursor display width */
-    int rows = (pwidth + bufwidth + l->cols - 1) / l->cols; /* rows used by current buf. */
+    size_t pwidth, bufwidth, poswidth;                      /* prompt, buffer and cursor display widths. */
+    int rows;                                               /* rows used by current buf. */
     int rpos = l->oldrpos;                                  /* cursor relative row from previous refresh. */
     int rpos2;                                              /* rpos after refresh. */
     int col;                                                /* column position, zero-based. */
@@ -1010,11 +1853,16 @@ static void refreshMultiLine(struct linenoiseState *l, int flags) {
     int fd = l->ofd, j;
     struct abuf ab;
 
+    widthsUpdate(l);
+    pwidth = l->pwidth;
+    bufwidth = l->lencol;
+    poswidth = l->poscol;
+    rows = (pwidth + bufwidth + l->cols - 1) / l->cols;
     l->oldrows = rows;
 
     /* First step: clear all the lines used before. To do so start by
      * going to the last row. */
-    abInit(&ab);
+    abInit(&ab, l);
 
     if (flags & REFRESH_CLEAN) {
         if (old_rows - rpos > 0) {
@@ -1049,7 +1897,7 @@ static void refreshMultiLine(struct linenoiseState *l, int flags) {
                 i += utf8NextCharLen(l->buf, i, l->len);
             }
         } else {
-            abAppend(&ab, l->buf, l->len);
+            abAppendText(&ab, l->buf, l->len);
         }
 
         /* Show hints if any. */
@@ -1097,12 +1945,18 @@ static void refreshMultiLine(struct linenoiseState *l, int flags) {
 
     if (write(fd, ab.b, ab.len) == -1) {
     } /* Can't recover from write error. */
-    abFree(&ab);
+    abKeep(&ab, l);
 }
 
 /* Calls the two low level functions refreshSingleLine() or
  * refreshMultiLine() according to the selected mode. */
 static void refreshLineWithFlags(struct linenoiseState *l, int flags) {
+    /* More keys are buffered: the refresh after the last one does it all. */
+    if (l->batching && inputPending()) {
+        l->refresh_pending = 1;
+        return;
+    }
+    l->refresh_pending = 0;
     if (mlmode)
         refreshMultiLine(l, flags);
     else
@@ -1131,29 +1985,62 @@ void linenoiseShow(struct linenoiseState *l) {
     }
 }
 
+/* Tell if keys already read from the terminal wait to be handled: then
+ * linenoiseEditFeed() can be called without waiting for the terminal to be
+ * readable. */
+int linenoiseEditPending(void) {
+    return inputPending() > 0;
+}
+
+/* Lay the line out again for the new width, if the terminal was resized
+ * since the line was drawn. linenoiseEditFeed() does it before handling a
+ * key; a program that waits for the terminal and for signals together can
+ * call it as soon as it sees SIGWINCH, to redraw without waiting for a key. */
+void linenoiseEditResize(struct linenoiseState *l) {
+    size_t cols;
+
+    if (!colsChanged)
+        return;
+    cols = getColumns(l->ifd, l->ofd);
+    if (cols == l->cols)
+        return;
+    l->cols = cols;
+    l->frame_cursor = -1;
+    if (l->in_completion)
+        refreshLineWithCompletion(l, NULL, REFRESH_ALL);
+    else
+        refreshLine(l);
+}
+
 /* Insert the character(s) 'c' of length 'clen' at cursor current position.
  * This handles both single-byte ASCII and multi-byte UTF-8 sequences.
  *
  * On error writing to the terminal -1 is returned, otherwise 0. */
 int linenoiseEditInsert(struct linenoiseState *l, const char *c, size_t clen) {
     if (l->len + clen <= l->buflen) {
+        size_t before = widthsEditStart(l, l->pos, l->pos);
         if (l->len == l->pos) {
             /* Append at end of line. */
             memcpy(l->buf + l->pos, c, clen);
             l->pos += clen;
             l->len += clen;
             l->buf[l->len] = '\0';
-            if ((!mlmode &&
-                 utf8StrWidth(l->prompt, l->plen) + utf8StrWidth(l->buf, l->len) < l->cols &&
-                 !hintsCallback)) {
+            widthsEditEnd(l, l->pos - clen, l->pos, before);
+            if (l->widths)
+                l->poscol += utf8SpanWidth(l->buf, l->pos - clen, l->pos);
+            if ((!mlmode && l->widths &&
+                 l->pwidth + l->lencol < l->cols &&
+                 !hintsCallback && !l->refresh_pending && !(l->batching && inputPending()))) {
                 /* Avoid a full update of the line in the trivial case:
-                 * single-width char, no hints, fits in one line. */
+                 * single-width char, no hints, fits in one line, and the
+                 * line on screen is up to date. */
                 if (maskmode == 1) {
                     if (write(l->ofd, "*", 1) == -1)
                         return -1;
                 } else {
                     if (write(l->ofd, c, clen) == -1)
                         return -1;
+                    frameAppend(l, c, clen, utf8SingleCharWidth(c, clen));
                 }
             } else {
                 refreshLine(l);
@@ -1165,16 +2052,97 @@ int linenoiseEditInsert(struct linenoiseState *l, const char *c, size_t clen) {
             l->len += clen;
             l->pos += clen;
             l->buf[l->len] = '\0';
+            widthsEditEnd(l, l->pos - clen, l->pos, before);
+            if (l->widths)
+                l->poscol += utf8SpanWidth(l->buf, l->pos - clen, l->pos);
             refreshLine(l);
         }
     }
     return 0;
 }
 
+/* Store a pasted byte at buf[*at], if it is below 'limit'. Carriage returns
+ * become newlines (the one of a CR LF pair is enough), tabs become spaces,
+ * and other control characters are dropped: the line shows them as they
+ * are stored. */
+static void pasteByte(struct linenoiseState *l, size_t *at, size_t limit, char c, int *cr) {
+    int was_cr = *cr;
+
+    *cr = c == '\r';
+    if (c == '\r')
+        c = '\n';
+    else if (c == '\n' && was_cr)
+        return;
+    else if (c == '\t')
+        c = ' ';
+    else if (((unsigned char)c < 32 && c != '\n') || c == 0x7F)
+        return;
+    if (*at < limit)
+        l->buf[(*at)++] = c;
+}
+
+/* Insert the text the terminal sends between ESC [ 200 ~ and ESC [ 201 ~
+ * when bracketed paste is on, ESC [ 200 ~ being already read. The paste is
+ * inserted at the cursor as one edit with one refresh, and its newlines are
+ * kept in the line instead of submitting it. What does not fit in the
+ * buffer is dropped. */
+static void linenoiseEditPaste(struct linenoiseState *l) {
+    static const char end[] = "\x1b[201~";
+    size_t tail = l->len - l->pos;
+    size_t limit = l->buflen - tail;
+    size_t start = l->pos, at = l->pos, lead;
+    size_t matched = 0, before;
+    int cr = 0;
+    char c;
+
+    /* Park the text after the cursor at the end of the buffer, so the
+     * paste is written in place and the tail moved only once. */
+    before = widthsEditStart(l, l->pos, l->pos);
+    memmove(l->buf + limit, l->buf + l->pos, tail);
+    while (matched < sizeof(end) - 1 && inputByte(l->ifd, &c) == 1) {
+        if (c == end[matched]) {
+            matched++;
+            continue;
+        }
+        /* Not the end of the paste after all: keep what was taken for it,
+         * but the ESC. */
+        if (matched) {
+            size_t i;
+
+            for (i = 1; i < matched; i++)
+                pasteByte(l, &at, limit, end[i], &cr);
+            matched = 0;
+        }
+        if (c == end[0])
+            matched = 1;
+        else
+            pasteByte(l, &at, limit, c, &cr);
+    }
+
+    /* Don't keep half a character when the buffer filled up. */
+    lead = at;
+    while (lead > start && ((unsigned char)l->buf[lead - 1] & 0xC0) == 0x80)
+        lead--;
+    if (lead > start && lead - 1 + utf8ByteLen(l->buf[lead - 1]) > at)
+        at = lead - 1;
+
+    memmove(l->buf + at, l->buf + limit, tail);
+    l->pos = at;
+    l->len = at + tail;
+    l->buf[l->len] = '\0';
+    widthsEditEnd(l, start, at, before);
+    if (l->widths)
+        l->poscol += utf8SpanWidth(l->buf, start, at);
+    refreshLine(l);
+}
+
 /* Move cursor on the left. Moves by one UTF-8 character, not byte. */
 void linenoiseEditMoveLeft(struct linenoiseState *l) {
     if (l->pos > 0) {
-        l->pos -= utf8PrevCharLen(l->buf, l->pos);
+        size_t clen = utf8PrevCharLen(l->buf, l->pos);
+        if (l->widths)
+            l->poscol -= utf8SpanWidth(l->buf, l->pos - clen, l->pos);
+        l->pos -= clen;
         refreshLine(l);
     }
 }
@@ -1182,7 +2150,10 @@ void linenoiseEditMoveLeft(struct linenoiseState *l) {
 /* Move cursor on the right. Moves by one UTF-8 character, not byte. */
 void linenoiseEditMoveRight(struct linenoiseState *l) {
     if (l->pos != l->len) {
-        l->pos += utf8NextCharLen(l->buf, l->pos, l->len);
+        size_t clen = utf8NextCharLen(l->buf, l->pos, l->len);
+        if (l->widths)
+            l->poscol += utf8SpanWidth(l->buf, l->pos, l->pos + clen);
+        l->pos += clen;
         refreshLine(l);
     }
 }
@@ -1191,6 +2162,7 @@ void linenoiseEditMoveRight(struct linenoiseState *l) {
 void linenoiseEditMoveHome(struct linenoiseState *l) {
     if (l->pos != 0) {
         l->pos = 0;
+        l->poscol = 0;
         refreshLine(l);
     }
 }
@@ -1199,6 +2171,7 @@ void linenoiseEditMoveHome(struct linenoiseState *l) {
 void linenoiseEditMoveEnd(struct linenoiseState *l) {
     if (l->pos != l->len) {
         l->pos = l->len;
+        l->poscol = l->lencol;
         refreshLine(l);
     }
 }
@@ -1208,36 +2181,154 @@ void linenoiseEditMoveEnd(struct linenoiseState *l) {
 #define LINENOISE_HISTORY_NEXT 0
 #define LINENOISE_HISTORY_PREV 1
 void linenoiseEditHistoryNext(struct linenoiseState *l, int dir) {
-    if (history_len > 1) {
-        /* Update the current history entry before to
-         * overwrite it with the next one. */
-        free(history[history_len - 1 - l->history_index]);
-        history[history_len - 1 - l->history_index] = strdup(l->buf);
-        /* Show the new entry */
-        l->history_index += (dir == LINENOISE_HISTORY_PREV) ? 1 : -1;
-        if (l->history_index < 0) {
-            l->history_index = 0;
+    if (history_len > 0) {
+        int index = l->history_index;
+
+        /* Remember the edits made to the shown entry before leaving it. */
+        if (historyEditEntry(l->history_index, l->buf) == -1)
             return;
-        } else if (l->history_index >= history_len) {
-            l->history_index = history_len - 1;
+        /* Show the new entry, going past the dead ones. At either end of
+         * the history the line stays as it is. */
+        do
+            index += (dir == LINENOISE_HISTORY_PREV) ? 1 : -1;
+        while (index > 0 && index <= history_len && historyDead(index));
+        if (index < 0 || index > history_len)
             return;
-        }
-        strncpy(l->buf, history[history_len - 1 - l->history_index], l->buflen);
+        l->history_index = index;
+        strncpy(l->buf, historyView(l->history_index), l->buflen);
         l->buf[l->buflen - 1] = '\0';
         l->len = l->pos = strlen(l->buf);
+        l->widths = 0;
         refreshLine(l);
     }
 }
 
-/* Delete the character at the right of the cursor without altering the cursor
- * position. Basically this is what happens with the "Delete" keyboard key.
- * Now handles multi-byte UTF-8 characters. */
-void linenoiseEditDelete(struct linenoiseState *l) {
-    if (l->len > 0 && l->pos < l->len) {
-        size_t clen = utf8NextCharLen(l->buf, l->pos, l->len);
+/* Show the reverse search prompt with the newest history entry older than
+ * the entry with id 'before' (0 for no limit) that contains the query. */
+static void searchUpdate(struct linenoiseState *l, uint32_t before) {
+    const char *state = "";
+    uint32_t id;
+    int index;
+
+    if (l->search_len) {
+        index = historySearch(l->search, l->search_len, before, &id);
+        if (index > 0) {
+            const char *line = historyView(index);
+            const char *match;
+
+            strncpy(l->buf, line, l->buflen);
+            l->buf[l->buflen - 1] = '\0';
+            l->len = strlen(l->buf);
+            match = strstr(l->buf, l->search);
+            l->pos = match ? (size_t)(match - l->buf) : l->len;
+            l->widths = 0;
+            l->search_id = id;
+            l->search_index = index;
+        } else {
+            state = "failed ";
+        }
+    }
+    snprintf(l->search_prompt, sizeof(l->search_prompt), "(%sreverse-i-search)`%s': ", state, l->search);
+    l->prompt = l->search_prompt;
+    l->plen = strlen(l->search_prompt);
+    l->pwidth = utf8StrWidth(l->prompt, l->plen);
+    refreshLine(l);
+}
+
+/* Leave reverse search mode, keeping the match in the buffer or, if
+ * 'cancel' is set or nothing matched, going back to the line that was
+ * being edited. */
+static void searchStop(struct linenoiseState *l, int cancel) {
+    l->in_search = 0;
+    l->prompt = l->saved_prompt;
+    l->plen = strlen(l->prompt);
+    l->pwidth = utf8StrWidth(l->prompt, l->plen);
+    if (cancel || l->search_index == 0) {
+        strncpy(l->buf, historyView(l->history_index), l->buflen);
+        l->buf[l->buflen - 1] = '\0';
+        l->len = l->pos = strlen(l->buf);
+        l->widths = 0;
+    } else {
+        /* Browsing the history goes on from the match. */
+        l->history_index = l->search_index;
+    }
+    refreshLine(l);
+}
+
+/* This is an helper function for linenoiseEdit*() and is called when the
+ * user presses Ctrl-R, and then for every key until the search ends. Like
+ * completeLine() it returns the character that should be handled next, or
+ * 0 when the key was consumed by the search. */
+static int searchLine(struct linenoiseState *l, char c) {
+    if (!l->in_search) {
+        /* Remember the line being edited, Ctrl-G goes back to it. */
+        if (historyEditEntry(l->history_index, l->buf) == -1)
+            return 0;
+        l->in_search = 1;
+        l->search[0] = '\0';
+        l->search_len = 0;
+        l->search_id = 0;
+        l->search_index = 0;
+        l->saved_prompt = l->prompt;
+        searchUpdate(l, 0);
+        return 0;
+    }
+
+    switch (c) {
+    case CTRL_R: /* Next older match */
+        if (l->search_len)
+            searchUpdate(l, l->search_id);
+        return 0;
+    case BACKSPACE:
+    case CTRL_H:
+        if (l->search_len) {
+            l->search_len -= utf8PrevCharLen(l->search, l->search_len);
+            l->search[l->search_len] = '\0';
+        }
+        l->search_id = l->search_index = 0;
+        searchUpdate(l, 0);
+        return 0;
+    case CTRL_G: /* Give up the search */
+        searchStop(l, 1);
+        return 0;
+    default:
+        if ((unsigned char)c >= 32 && c != BACKSPACE) {
+            char utf8[4];
+            int utf8len = utf8ByteLen(c);
+            int i;
+
+            utf8[0] = c;
+            for (i = 1; i < utf8len; i++) {
+                if (inputByte(l->ifd, utf8 + i) != 1)
+                    return 0;
+            }
+            if (l->search_len + utf8len < sizeof(l->search)) {
+                memcpy(l->search + l->search_len, utf8, utf8len);
+                l->search_len += utf8len;
+                l->search[l->search_len] = '\0';
+            }
+            /* The current match is still fine if it contains the longer
+             * query, so search from it included. */
+            searchUpdate(l, l->search_id ? l->search_id + 1 : 0);
+            return 0;
+        }
+        /* Any other key ends the search and is then handled as usual. */
+        searchStop(l, 0);
+        return c;
+    }
+}
+
+/* Delete the character at the right of the cursor without altering the cursor
+ * position. Basically this is what happens with the "Delete" keyboard key.
+ * Now handles multi-byte UTF-8 characters. */
+void linenoiseEditDelete(struct linenoiseState *l) {
+    if (l->len > 0 && l->pos < l->len) {
+        size_t clen = utf8NextCharLen(l->buf, l->pos, l->len);
+        size_t before = widthsEditStart(l, l->pos, l->pos + clen);
         memmove(l->buf + l->pos, l->buf + l->pos + clen, l->len - l->pos - clen);
         l->len -= clen;
         l->buf[l->len] = '\0';
+        widthsEditEnd(l, l->pos, l->pos, before);
         refreshLine(l);
     }
 }
@@ -1246,10 +2337,14 @@ void linenoiseEditDelete(struct linenoiseState *l) {
 void linenoiseEditBackspace(struct linenoiseState *l) {
     if (l->pos > 0 && l->len > 0) {
         size_t clen = utf8PrevCharLen(l->buf, l->pos);
+        size_t before = widthsEditStart(l, l->pos - clen, l->pos);
+        if (l->widths)
+            l->poscol -= utf8SpanWidth(l->buf, l->pos - clen, l->pos);
         memmove(l->buf + l->pos - clen, l->buf + l->pos, l->len - l->pos);
         l->pos -= clen;
         l->len -= clen;
         l->buf[l->len] = '\0';
+        widthsEditEnd(l, l->pos, l->pos, before);
         refreshLine(l);
     }
 }
@@ -1258,7 +2353,7 @@ void linenoiseEditBackspace(struct linenoiseState *l) {
  * current word. Handles UTF-8 by moving character-by-character. */
 void linenoiseEditDeletePrevWord(struct linenoiseState *l) {
     size_t old_pos = l->pos;
-    size_t diff;
+    size_t diff, before;
 
     /* Skip spaces before the word (move backwards by UTF-8 chars). */
     while (l->pos > 0 && l->buf[l->pos - 1] == ' ')
@@ -1267,8 +2362,12 @@ void linenoiseEditDeletePrevWord(struct linenoiseState *l) {
     while (l->pos > 0 && l->buf[l->pos - 1] != ' ')
         l->pos -= utf8PrevCharLen(l->buf, l->pos);
     diff = old_pos - l->pos;
+    before = widthsEditStart(l, l->pos, old_pos);
+    if (l->widths)
+        l->poscol -= utf8SpanWidth(l->buf, l->pos, old_pos);
     memmove(l->buf + l->pos, l->buf + old_pos, l->len - old_pos + 1);
     l->len -= diff;
+    widthsEditEnd(l, l->pos, l->pos, before);
     refreshLine(l);
 }
 
@@ -1306,17 +2405,32 @@ int linenoiseEditStart(struct linenoiseState *l, int stdin_fd, int stdout_fd, ch
     l->buflen = buflen;
     l->prompt = prompt;
     l->plen = strlen(prompt);
+    l->pwidth = utf8StrWidth(prompt, l->plen);
     l->oldpos = l->pos = 0;
     l->len = 0;
+    l->poscol = l->lencol = 0;
+    l->scroll = l->scrollcol = 0;
+    l->widths = 1;
+    l->render = NULL;
+    l->render_size = 0;
+    l->frame[0] = l->frame[1] = NULL;
+    l->frame_size[0] = l->frame_size[1] = 0;
+    l->frame_len = 0;
+    l->frame_cursor = -1;
+    l->batching = 0;
+    l->refresh_pending = 0;
+    l->completion_req = NULL;
 
     /* Enter raw mode. */
     if (enableRawMode(l->ifd) == -1)
         return -1;
 
-    l->cols = getColumns(stdin_fd, stdout_fd);
+    installWinchHandler();
+    l->cols = getColumns(l->ifd, l->ofd);
     l->oldrows = 0;
     l->oldrpos = 1; /* Cursor starts on row 1. */
     l->history_index = 0;
+    l->in_search = 0;
 
     /* Buffer starts empty. */
     l->buf[0] = '\0';
@@ -1328,56 +2442,41 @@ int linenoiseEditStart(struct linenoiseState *l, int stdin_fd, int stdout_fd, ch
     if (!isatty(l->ifd) && !getenv("LINENOISE_ASSUME_TTY"))
         return 0;
 
-    /* The latest history entry is always our current buffer, that
-     * initially is just an empty string. */
-    linenoiseHistoryAdd("");
+    /* History index 0 is the line being typed, it is saved in the
+     * history scratch slot only when the user starts browsing. */
+    historyEndEdit();
 
+    /* Have the terminal mark pasted text, so that it is inserted as it is
+     * and not run line by line. */
+    if (write(l->ofd, LINENOISE_PASTE_ON, sizeof(LINENOISE_PASTE_ON) - 1) == -1)
+        return -1;
     if (write(l->ofd, prompt, l->plen) == -1)
         return -1;
+    if (!mlmode && frameBuild(l, "", 0) >= 0)
+        frameCommit(l, l->plen, l->pwidth);
+    /* Index the history for Ctrl-R until the user types. */
+    searchIndexIdle(l->ifd);
     return 0;
 }
 
 char *linenoiseEditMore = "If you see this, you are misusing the API: when linenoiseEditFeed() is called, if it returns linenoiseEditMore the user is yet editing the line. See the README file for more information.";
 
-/* This function is part of the multiplexed API of linenoise, see the top
- * comment on linenoiseEditStart() for more information. Call this function
- * each time there is some data to read from the standard input file
- * descriptor. In the case of blocking operations, this function can just be
- * called in a loop, and block.
- *
- * The function returns linenoiseEditMore to signal that line editing is still
- * in progress, that is, the user didn't yet pressed enter / CTRL-D. Otherwise
- * the function returns the pointer to the heap-allocated buffer with the
- * edited line, that the user should free with linenoiseFree().
- *
- * On special conditions, NULL is returned and errno is populated:
- *
- * EAGAIN if the user pressed Ctrl-C
- * ENOENT if the user pressed Ctrl-D
- *
- * Some other errno: I/O error.
- */
-char *linenoiseEditFeed(struct linenoiseState *l) {
-    /* Not a TTY, pass control to line reading without character
-     * count limits. */
-    if (!isatty(l->ifd) && !getenv("LINENOISE_ASSUME_TTY"))
-        return linenoiseNoTTY();
-
+/* Handle the next key of the input, see linenoiseEditFeed(). */
+static char *linenoiseEditKey(struct linenoiseState *l) {
     char c;
     int nread;
-    char seq[3];
+    char seq[5];
 
-    nread = read(l->ifd, &c, 1);
+    nread = inputByte(l->ifd, &c);
     if (nread < 0) {
         return (errno == EAGAIN || errno == EWOULDBLOCK) ? linenoiseEditMore : NULL;
     } else if (nread == 0) {
         return NULL;
     }
-
     /* Only autocomplete when the callback is set. It returns < 0 when
      * there was an error reading from fd. Otherwise it will return the
      * character that should be handled next. */
-    if ((l->in_completion || c == 9) && completionCallback != NULL) {
+    if ((l->in_completion || c == 9) && completionCallback != NULL && !l->in_search) {
         c = completeLine(l, c);
         /* Return on errors */
         if (c < 0)
@@ -1387,10 +2486,19 @@ char *linenoiseEditFeed(struct linenoiseState *l) {
             return linenoiseEditMore;
     }
 
+    /* Reverse incremental history search. Returns the character to handle
+     * next when the key ended the search, 0 otherwise. */
+    if (l->in_search || c == CTRL_R) {
+        c = searchLine(l, c);
+        if (c == 0)
+            return linenoiseEditMore;
+    }
+
     switch (c) {
-    case ENTER: /* enter */
-        history_len--;
-        free(history[history_len]);
+    case CTRL_J: /* enter, translated to newline by the tty */
+    case ENTER:  /* enter */
+        /* The line is final: show it now, not after the queued keys. */
+        l->batching = 0;
         if (mlmode)
             linenoiseEditMoveEnd(l);
         if (hintsCallback) {
@@ -1414,8 +2522,6 @@ char *linenoiseEditFeed(struct linenoiseState *l) {
         if (l->len > 0) {
             linenoiseEditDelete(l);
         } else {
-            history_len--;
-            free(history[history_len]);
             errno = ENOENT;
             return NULL;
         }
@@ -1433,6 +2539,7 @@ char *linenoiseEditFeed(struct linenoiseState *l) {
             memcpy(l->buf + prevstart, tmp, currlen);
             if (l->pos + currlen <= l->len)
                 l->pos += currlen;
+            l->widths = 0;
             refreshLine(l);
         }
         break;
@@ -1452,16 +2559,16 @@ char *linenoiseEditFeed(struct linenoiseState *l) {
         /* Read the next two bytes representing the escape sequence.
          * Use two calls to handle slow terminals returning the two
          * chars at different times. */
-        if (read(l->ifd, seq, 1) == -1)
+        if (inputByte(l->ifd, seq) == -1)
             break;
-        if (read(l->ifd, seq + 1, 1) == -1)
+        if (inputByte(l->ifd, seq + 1) == -1)
             break;
 
         /* ESC [ sequences. */
         if (seq[0] == '[') {
             if (seq[1] >= '0' && seq[1] <= '9') {
                 /* Extended escape, read additional byte. */
-                if (read(l->ifd, seq + 2, 1) == -1)
+                if (inputByte(l->ifd, seq + 2) == -1)
                     break;
                 if (seq[2] == '~') {
                     switch (seq[1]) {
@@ -1469,6 +2576,18 @@ char *linenoiseEditFeed(struct linenoiseState *l) {
                         linenoiseEditDelete(l);
                         break;
                     }
+                } else if (seq[1] == '2' && seq[2] == '0') {
+                    /* F9 is ESC [ 20 ~, ignored. The start of a bracketed
+                     * paste is ESC [ 200 ~, and its end ESC [ 201 ~ is
+                     * dropped when it comes without a start. */
+                    if (inputByte(l->ifd, seq + 3) == -1 || seq[3] == '~')
+                        break;
+                    if (seq[3] != '0' && seq[3] != '1')
+                        break;
+                    if (inputByte(l->ifd, seq + 4) == -1)
+                        break;
+                    if (seq[3] == '0' && seq[4] == '~')
+                        linenoiseEditPaste(l);
                 }
             } else {
                 switch (seq[1]) {
@@ -1518,7 +2637,7 @@ char *linenoiseEditFeed(struct linenoiseState *l) {
                 /* Read remaining bytes of the UTF-8 sequence. */
                 int i;
                 for (i = 1; i < utf8len; i++) {
-                    if (read(l->ifd, utf8 + i, 1) != 1)
+                    if (inputByte(l->ifd, utf8 + i) != 1)
                         break;
                 }
             }
@@ -1529,12 +2648,18 @@ char *linenoiseEditFeed(struct linenoiseState *l) {
     case CTRL_U: /* Ctrl+u, delete the whole line. */
         l->buf[0] = '\0';
         l->pos = l->len = 0;
+        l->poscol = l->lencol = 0;
+        l->scroll = l->scrollcol = 0;
         refreshLine(l);
         break;
     case CTRL_K: /* Ctrl+k, delete from current to end of line. */
-        l->buf[l->pos] = '\0';
-        l->len = l->pos;
-        refreshLine(l);
+        {
+            size_t before = widthsEditStart(l, l->pos, l->len);
+            l->buf[l->pos] = '\0';
+            l->len = l->pos;
+            widthsEditEnd(l, l->pos, l->pos, before);
+            refreshLine(l);
+        }
         break;
     case CTRL_A: /* Ctrl+a, go to the start of the line */
         linenoiseEditMoveHome(l);
@@ -1544,6 +2669,7 @@ char *linenoiseEditFeed(struct linenoiseState *l) {
         break;
     case CTRL_L: /* ctrl+l, clear screen */
         linenoiseClearScreen();
+        l->frame_cursor = -1;
         refreshLine(l);
         break;
     case CTRL_W: /* ctrl+w, delete previous word */
@@ -1553,13 +2679,79 @@ char *linenoiseEditFeed(struct linenoiseState *l) {
     return linenoiseEditMore;
 }
 
+/* This function is part of the multiplexed API of linenoise, see the top
+ * comment on linenoiseEditStart() for more information. Call this function
+ * each time there is some data to read from the standard input file
+ * descriptor. In the case of blocking operations, this function can just be
+ * called in a loop, and block.
+ *
+ * The function returns linenoiseEditMore to signal that line editing is still
+ * in progress, that is, the user didn't yet pressed enter / CTRL-D. Otherwise
+ * the function returns the pointer to the heap-allocated buffer with the
+ * edited line, that the user should free with linenoiseFree().
+ *
+ * On special conditions, NULL is returned and errno is populated:
+ *
+ * EAGAIN if the user pressed Ctrl-C
+ * ENOENT if the user pressed Ctrl-D
+ *
+ * Some other errno: I/O error.
+ */
+char *linenoiseEditFeed(struct linenoiseState *l) {
+    char *res;
+
+    /* Not a TTY, pass control to line reading without character
+     * count limits. */
+    if (!isatty(l->ifd) && !getenv("LINENOISE_ASSUME_TTY"))
+        return linenoiseNoTTY();
+
+    linenoiseEditResize(l);
+
+    /* Show the completions found in the background. If they are why the
+     * caller was woken up, there may be no key to read. */
+    if (completionAsync && completionDrain()) {
+        completionUpdate(l);
+        if (!inputPending() && !inputReady(l->ifd))
+            return linenoiseEditMore;
+    }
+
+    /* Handle all the keys the terminal has, the line being refreshed once
+     * after the last of them. */
+    l->batching = 1;
+    do {
+        res = linenoiseEditKey(l);
+    } while (res == linenoiseEditMore && inputQueued(l->ifd));
+    l->batching = 0;
+    if (l->refresh_pending) {
+        if (l->in_completion)
+            refreshLineWithCompletion(l, NULL, REFRESH_ALL);
+        else
+            refreshLine(l);
+    }
+    if (res == linenoiseEditMore)
+        searchIndexIdle(l->ifd);
+    return res;
+}
+
 /* This is part of the multiplexed linenoise API. See linenoiseEditStart()
  * for more information. This function is called when linenoiseEditFeed()
  * returns something different than NULL. At this point the user input
  * is in the buffer, and we can restore the terminal in normal mode. */
 void linenoiseEditStop(struct linenoiseState *l) {
+    completionStop(l);
+    historyEndEdit();
+    free(l->render);
+    l->render = NULL;
+    l->render_size = 0;
+    free(l->frame[0]);
+    free(l->frame[1]);
+    l->frame[0] = l->frame[1] = NULL;
+    l->frame_size[0] = l->frame_size[1] = 0;
+    l->frame_cursor = -1;
     if (!isatty(l->ifd) && !getenv("LINENOISE_ASSUME_TTY"))
         return;
+    if (write(l->ofd, LINENOISE_PASTE_OFF, sizeof(LINENOISE_PASTE_OFF) - 1) == -1) {
+    } /* The terminal is left as it is. */
     disableRawMode(l->ifd);
     printf("\n");
 }
@@ -1697,139 +2889,1034 @@ void linenoiseFree(void *ptr) {
 
 /* ================================ History ================================= */
 
-/* Free the history, but does not reset it. Only used when we have to
- * exit() to avoid memory leaks are reported by valgrind & co. */
-static void freeHistory(void) {
-    if (history) {
-        int j;
+/* The history ring grows geometrically until it holds history_max_len
+ * entries. From then on adding a line overwrites the oldest one, so adding,
+ * evicting and browsing are all O(1) whatever the history size.
+ *
+ * The text of the entries lives in chunks of LINENOISE_HISTORY_CHUNK_SIZE
+ * bytes (or a chunk of its own for longer lines). Every chunk counts the
+ * entries still using it and is freed when the last of them is evicted. */
+#define LINENOISE_HISTORY_CHUNK_SIZE 65536
 
-        for (j = 0; j < history_len; j++)
-            free(history[j]);
-        free(history);
+/* Ring slot of the entry 'i' positions after the oldest one. */
+static int historySlot(int i) {
+    return (history_start + i) % history_cap;
+}
+
+/* Return the position (0 is the oldest) of the first entry whose id is not
+ * lower than 'id', or history_len if there is none. The ring is sorted by
+ * id, so this is a binary search. */
+static int historyLowerBound(uint32_t id) {
+    int lo = 0, hi = history_len;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (history[historySlot(mid)].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Copy 'len' bytes of 'line' into the chunk being filled, starting a new
+ * chunk if it is full. Returns NULL when out of memory. */
+static char *historyStore(const char *line, size_t len, struct historyChunk **chunk) {
+    struct historyChunk *c = history_chunk;
+    char *str;
+
+    if (c == NULL || c->size - c->used < len + 1) {
+        size_t size = len + 1 > LINENOISE_HISTORY_CHUNK_SIZE ? len + 1 : LINENOISE_HISTORY_CHUNK_SIZE;
+
+        c = malloc(sizeof(*c) + size);
+        if (c == NULL)
+            return NULL;
+        c->used = 0;
+        c->size = size;
+        c->live = 0;
+        /* From now on the old chunk is only kept alive by its entries. */
+        if (history_chunk && history_chunk->live == 0)
+            free(history_chunk);
+        history_chunk = c;
+    }
+    str = c->data + c->used;
+    memcpy(str, line, len);
+    str[len] = '\0';
+    c->used += len + 1;
+    c->live++;
+    *chunk = c;
+    return str;
+}
+
+/* Drop an entry, freeing its chunk if nothing else uses it anymore. A dead
+ * entry was dropped already. */
+static void historyRelease(struct historyEntry *e) {
+    if (e->str == NULL)
+        return;
+    if (search_index)
+        search_dead++;
+    if (history_set)
+        historySetDelete(e);
+    free(e->edit);
+    e->edit = NULL;
+    if (e->chunk && --e->chunk->live == 0 && e->chunk != history_chunk)
+        free(e->chunk);
+    e->str = NULL;
+    e->chunk = NULL;
+}
+
+/* Return the text shown for history index 'index': 0 is the line typed
+ * before browsing, 1 the newest entry, history_len the oldest one. */
+static const char *historyView(int index) {
+    struct historyEntry *e;
+
+    if (index == 0)
+        return history_scratch ? history_scratch : "";
+    e = &history[historySlot(history_len - index)];
+    return e->edit ? e->edit : e->str;
+}
+
+/* Tell if history index 'index' is a removed entry, see historyRemove(). */
+static int historyDead(int index) {
+    return index > 0 && history[historySlot(history_len - index)].str == NULL;
+}
+
+/* Remember 'line' as the edited text of history index 'index' until the
+ * line is accepted. The history itself is never modified by browsing.
+ * Returns -1 when out of memory. */
+static int historyEditEntry(int index, const char *line) {
+    char **edit = &history_scratch;
+    char *copy;
+
+    if (index > 0) {
+        int slot = historySlot(history_len - index);
+        struct historyEntry *e = &history[slot];
+
+        if (e->edit == NULL) {
+            if (!strcmp(e->str, line))
+                return 0;
+            if (history_edited_len == history_edited_cap) {
+                int cap = history_edited_cap ? history_edited_cap * 2 : 8;
+                int *edited = realloc(history_edited, sizeof(int) * cap);
+
+                if (edited == NULL)
+                    return -1;
+                history_edited = edited;
+                history_edited_cap = cap;
+            }
+            history_edited[history_edited_len++] = slot;
+        }
+        edit = &e->edit;
     }
+    if (*edit && !strcmp(*edit, line))
+        return 0;
+    copy = strdup(line);
+    if (copy == NULL)
+        return -1;
+    free(*edit);
+    *edit = copy;
+    return 0;
+}
+
+/* Forget the edits made while browsing: they belonged to the line being
+ * edited, not to the history. */
+static void historyEndEdit(void) {
+    int j;
+
+    for (j = 0; j < history_edited_len; j++) {
+        free(history[history_edited[j]].edit);
+        history[history_edited[j]].edit = NULL;
+    }
+    history_edited_len = 0;
+    free(history_scratch);
+    history_scratch = NULL;
+}
+
+/* Free the history. Only used when we have to exit() to avoid memory
+ * leaks are reported by valgrind & co. */
+static void freeHistory(void) {
+    int j;
+
+    historyEndEdit();
+    historySetFree();
+    for (j = 0; j < history_len; j++)
+        historyRelease(&history[historySlot(j)]);
+    free(history_chunk);
+    free(history);
+    free(history_edited);
+    searchIndexFree();
+    history_chunk = NULL;
+    history = NULL;
+    history_edited = NULL;
+    history_len = history_cap = history_start = history_edited_cap = history_dead = 0;
 }
 
 /* At exit we'll try to fix the terminal to the initial conditions. */
 static void linenoiseAtExit(void) {
+    /* Exiting in the middle of an edit: bracketed paste is still on. */
+    if (rawmode && write(STDOUT_FILENO, LINENOISE_PASTE_OFF, sizeof(LINENOISE_PASTE_OFF) - 1) == -1) {
+    }
     disableRawMode(STDIN_FILENO);
     freeHistory();
 }
 
+/* Make sure the ring has a slot for one more entry, growing it while it
+ * holds fewer than history_max_len live entries. Past those it keeps room
+ * for the dead entries historyRemove() leaves, and drops them once that is
+ * used up too. Until the first eviction the entries start at slot 0, so
+ * realloc() keeps them in order. Returns -1 when out of memory. */
+static int historyReserve(void) {
+    int max = history_max_len + history_max_len / 2 + 64;
+    int cap = history_cap ? history_cap * 2 : 16;
+    struct historyEntry *ring;
+
+    if (history_len < history_cap || history_len - history_dead == history_max_len)
+        return 0;
+    if (cap > max)
+        cap = max;
+    if (cap <= history_cap || history_start != 0) {
+        if (historyPack(cap > history_cap ? cap : history_cap) == -1)
+            return -1;
+        return history_len < history_cap ? 0 : -1;
+    }
+    ring = realloc(history, sizeof(*ring) * cap);
+    if (ring == NULL)
+        return -1;
+    history = ring;
+    history_cap = cap;
+    return 0;
+}
+
+/* Add an entry as the newest one, evicting the oldest live one, and the
+ * dead ones before it, if the history is full. The ring must have been
+ * grown with historyReserve(). */
+static void historyPush(char *str, size_t len, struct historyChunk *chunk) {
+    struct historyEntry *e;
+
+    while (history_len - history_dead == history_max_len) {
+        if (history[history_start].str == NULL)
+            history_dead--;
+        historyRelease(&history[history_start]);
+        history_start = (history_start + 1) % history_cap;
+        history_len--;
+    }
+    e = &history[historySlot(history_len)];
+    e->str = str;
+    e->len = len;
+    e->chunk = chunk;
+    e->edit = NULL;
+    e->id = history_next_id++;
+    history_len++;
+
+    /* Keep the search index up to date, or drop it when it is mostly made
+     * of evicted entries so that it is built again. While it is being built
+     * the entry is left to searchIndexStep(). */
+    if (search_index) {
+        if (search_dead > (size_t)history_len)
+            searchIndexFree();
+        else if (search_next == e->id && searchIndexAdd(e) == -1)
+            searchIndexFree();
+        else if (search_next == e->id)
+            search_next++;
+    }
+}
+
+/* ========================== History deduplication ========================= */
+
+/* In global dedup mode (linenoiseHistorySetDedup()) adding a line that is
+ * already in the history moves it to the newest position instead of adding
+ * a copy. The entries are found through a hash set of their ids, keyed by
+ * the hash of their text. The set is built the first time a line is added,
+ * so loading the history stays cheap; building it also drops the copies
+ * found in the history file. */
+
+/* FNV-1a */
+static uint32_t historyHash(const char *str, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t j;
+
+    for (j = 0; j < len; j++) {
+        h ^= (unsigned char)str[j];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Return the position of the entry holding 'str', or -1. */
+static int historySetFind(const char *str, size_t len, uint32_t hash) {
+    size_t i;
+
+    for (i = hash & (history_set_size - 1); history_set[i].id; i = (i + 1) & (history_set_size - 1)) {
+        if (history_set[i].hash == hash) {
+            int pos = historyLowerBound(history_set[i].id);
+            struct historyEntry *e = &history[historySlot(pos)];
+
+            if (pos < history_len && e->id == history_set[i].id && e->len == len &&
+                !memcmp(e->str, str, len))
+                return pos;
+        }
+    }
+    return -1;
+}
+
+static int historySetInsert(uint32_t id, uint32_t hash) {
+    size_t i;
+
+    /* Double the table once it is three quarters full. */
+    if ((history_set_used + 1) * 4 > history_set_size * 3) {
+        struct historyKey *old = history_set;
+        size_t oldsize = history_set_size, j;
+
+        history_set = calloc(oldsize * 2, sizeof(*history_set));
+        if (history_set == NULL) {
+            history_set = old;
+            return -1;
+        }
+        history_set_size = oldsize * 2;
+        for (j = 0; j < oldsize; j++) {
+            if (!old[j].id)
+                continue;
+            for (i = old[j].hash & (history_set_size - 1); history_set[i].id; i = (i + 1) & (history_set_size - 1))
+                ;
+            history_set[i] = old[j];
+        }
+        free(old);
+    }
+    for (i = hash & (history_set_size - 1); history_set[i].id; i = (i + 1) & (history_set_size - 1))
+        ;
+    history_set[i].id = id;
+    history_set[i].hash = hash;
+    history_set_used++;
+    return 0;
+}
+
+/* Remove the entry 'e' from the set, if it is there. The following buckets
+ * of the probe sequence are shifted back so lookups still find them. */
+static void historySetDelete(struct historyEntry *e) {
+    size_t mask = history_set_size - 1;
+    size_t i = historyHash(e->str, e->len) & mask, j;
+
+    while (history_set[i].id != e->id) {
+        if (!history_set[i].id)
+            return;
+        i = (i + 1) & mask;
+    }
+    history_set_used--;
+    for (j = (i + 1) & mask; history_set[j].id; j = (j + 1) & mask) {
+        size_t home = history_set[j].hash & mask;
+
+        /* Move the key back unless its home bucket lies after the hole. */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            history_set[i] = history_set[j];
+            i = j;
+        }
+    }
+    history_set[i].id = 0;
+}
+
+static void historySetFree(void) {
+    free(history_set);
+    history_set = NULL;
+    history_set_size = history_set_used = 0;
+}
+
+/* Lay the live entries out from slot 0 of a ring of 'cap' slots, dropping
+ * the dead ones. Returns -1 when out of memory. */
+static int historyPack(int cap) {
+    struct historyEntry *ring = malloc(sizeof(*ring) * (cap ? cap : 1));
+    int j, kept = 0;
+
+    if (ring == NULL)
+        return -1;
+    /* Pending edits are kept by slot. */
+    historyEndEdit();
+    for (j = 0; j < history_len; j++) {
+        struct historyEntry *e = &history[historySlot(j)];
+
+        if (e->str != NULL)
+            ring[kept++] = *e;
+    }
+    free(history);
+    history = ring;
+    history_cap = cap;
+    history_start = 0;
+    history_len = kept;
+    history_dead = 0;
+    return 0;
+}
+
+/* Remove the entry at position 'pos'. The entry is only marked dead, and
+ * skipped by browsing, searching and saving, so that removing costs O(1);
+ * the ring is packed once the dead entries outnumber the live ones, which
+ * keeps the cost O(1) amortized. */
+static void historyRemove(int pos) {
+    historyRelease(&history[historySlot(pos)]);
+    history_dead++;
+    if (history_dead > 64 && history_dead > history_len - history_dead)
+        historyPack(history_cap);
+}
+
+/* Build the set from the history, newest entry first, dropping the older
+ * copies of the lines found more than once. */
+static int historySetBuild(void) {
+    int j, dropped = 0;
+
+    history_set = calloc(1024, sizeof(*history_set));
+    if (history_set == NULL)
+        return -1;
+    history_set_size = 1024;
+    for (j = history_len - 1; j >= 0; j--) {
+        struct historyEntry *e = &history[historySlot(j)];
+        uint32_t hash;
+
+        if (e->str == NULL)
+            continue;
+        hash = historyHash(e->str, e->len);
+        if (historySetFind(e->str, e->len, hash) != -1) {
+            historyRelease(e);
+            history_dead++;
+            dropped = 1;
+        } else if (historySetInsert(e->id, hash) == -1) {
+            historySetFree();
+            return -1;
+        }
+    }
+    if (dropped)
+        historyPack(history_cap);
+    return 0;
+}
+
 /* This is the API call to add a new entry in the linenoise history.
- * It uses a fixed array of char pointers that are shifted (memmoved)
- * when the history max length is reached in order to remove the older
- * entry and make room for the new one, so it is not exactly suitable for huge
- * histories, but will work well for a few hundred of entries.
- *
- * Using a circular buffer is smarter, but a bit more complex to handle. */
+ * When the history max length is reached the oldest entry is evicted to
+ * make room for the new one. Returns 1 if the line was added, 0 if it was
+ * not (a repeat of the previous line, or out of memory). */
 int linenoiseHistoryAdd(const char *line) {
-    char *linecopy;
+    struct historyChunk *chunk;
+    struct historyEntry *last;
+    size_t len = strlen(line);
+    uint32_t hash = 0;
+    char *str;
+    int pos;
 
     if (history_max_len == 0)
         return 0;
 
-    /* Initialization on first call. */
-    if (history == NULL) {
-        history = malloc(sizeof(char *) * history_max_len);
-        if (history == NULL)
+    /* Don't add duplicated lines. */
+    if (history_len) {
+        last = &history[historySlot(history_len - 1)];
+        if (last->str && last->len == len && !memcmp(last->str, line, len))
             return 0;
-        memset(history, 0, (sizeof(char *) * history_max_len));
     }
 
-    /* Don't add duplicated lines. */
-    if (history_len && !strcmp(history[history_len - 1], line))
-        return 0;
+    /* In global dedup mode an older copy of the line is removed, so the
+     * line moves to the newest position. */
+    if (history_dedup && (history_set || historySetBuild() == 0)) {
+        hash = historyHash(line, len);
+        pos = historySetFind(line, len, hash);
+        if (pos != -1)
+            historyRemove(pos);
+    }
 
-    /* Add an heap allocated copy of the line in the history.
-     * If we reached the max length, remove the older line. */
-    linecopy = strdup(line);
-    if (!linecopy)
+    if (historyReserve() == -1)
         return 0;
-    if (history_len == history_max_len) {
-        free(history[0]);
-        memmove(history, history + 1, sizeof(char *) * (history_max_len - 1));
-        history_len--;
-    }
-    history[history_len] = linecopy;
-    history_len++;
+    str = historyStore(line, len, &chunk);
+    if (str == NULL)
+        return 0;
+    historyPush(str, len, chunk);
+    if (history_set && historySetInsert(history[historySlot(history_len - 1)].id, hash) == -1)
+        historySetFree();
     return 1;
 }
 
+/* Enable or disable global deduplication: when enabled, adding a line that
+ * is already in the history moves it to the newest position instead of
+ * adding a copy of it, and the copies loaded from a history file are
+ * dropped. */
+void linenoiseHistorySetDedup(int dedup) {
+    history_dedup = dedup;
+    if (!dedup)
+        historySetFree();
+}
+
 /* Set the maximum length for the history. This function can be called even
  * if there is already some history, the function will make sure to retain
  * just the latest 'len' elements if the new history length value is smaller
  * than the amount of items already inside the history. */
 int linenoiseHistorySetMaxLen(int len) {
-    char **new;
-
     if (len < 1)
         return 0;
+    historyEndEdit();
     if (history) {
-        int tocopy = history_len;
+        struct historyEntry *ring;
+        int j;
 
-        new = malloc(sizeof(char *) * len);
-        if (new == NULL)
+        if (history_dead && historyPack(history_cap) == -1)
             return 0;
-
-        /* If we can't copy everything, free the elements we'll not use. */
-        if (len < tocopy) {
-            int j;
-
-            for (j = 0; j < tocopy - len; j++)
-                free(history[j]);
-            tocopy = len;
+        /* Evict the entries that no longer fit. */
+        while (history_len > len) {
+            historyRelease(&history[history_start]);
+            history_start = (history_start + 1) % history_cap;
+            history_len--;
         }
-        memset(new, 0, sizeof(char *) * len);
-        memcpy(new, history + (history_len - tocopy), sizeof(char *) * tocopy);
+        /* Lay the entries out from slot 0 again. */
+        ring = malloc(sizeof(*ring) * (history_len ? history_len : 1));
+        if (ring == NULL)
+            return 0;
+        for (j = 0; j < history_len; j++)
+            ring[j] = history[historySlot(j)];
         free(history);
-        history = new;
+        history = ring;
+        history_cap = history_len ? history_len : 1;
+        history_start = 0;
     }
     history_max_len = len;
-    if (history_len > history_max_len)
-        history_len = history_max_len;
     return 1;
 }
 
-/* Save the history in the specified file. On success 0 is returned
- * otherwise -1 is returned. */
-int linenoiseHistorySave(const char *filename) {
+/* ============================= History search ============================= */
+
+/* Ctrl-R searches the history through an index of its grams: for every
+ * sequence of one, two and three bytes found in the history, the ids of the
+ * entries containing it, oldest first. A query is answered by walking,
+ * newest first, the shortest list among the query trigrams, or the list of
+ * the query itself when it is shorter than a trigram, and checking each
+ * candidate with memmem().
+ *
+ * The index is built while the editor waits for keys, a slice of entries at
+ * a time, so neither loading the history nor the first search waits for
+ * it; a search made before it is complete finishes it. From then on it is
+ * kept up to date by linenoiseHistoryAdd(). Ids of evicted entries are left
+ * in the lists and skipped by searches; once they outnumber the live
+ * entries the index is dropped and built again. The index itself is
+ * declared with the history at the top of the file. */
+
+#define LINENOISE_SEARCH_STEP 256 /* Entries indexed between two key checks. */
+
+/* The gram of 'n' bytes, 1 to 3, starting at 's'. The top byte holds the
+ * length, which tells grams apart and keeps the key from ever being 0. */
+static uint32_t gramKey(const char *s, size_t n) {
+    uint32_t key = (uint32_t)n << 24;
+    size_t j;
+
+    for (j = 0; j < n; j++)
+        key |= (uint32_t)(unsigned char)s[j] << (8 * (n - 1 - j));
+    return key;
+}
+
+static size_t gramBucket(uint32_t key) {
+    return (key * 2654435761u) & (search_index_size - 1);
+}
+
+/* Return the list of 'key', or NULL if no entry contains it. */
+static struct gramList *gramLookup(uint32_t key) {
+    size_t i;
+
+    for (i = gramBucket(key); search_index[i].key; i = (i + 1) & (search_index_size - 1)) {
+        if (search_index[i].key == key)
+            return &search_index[i];
+    }
+    return NULL;
+}
+
+/* Double the table once it is three quarters full. */
+static int searchIndexGrow(void) {
+    struct gramList *old = search_index;
+    size_t oldsize = search_index_size, j;
+
+    search_index = calloc(oldsize * 2, sizeof(*search_index));
+    if (search_index == NULL) {
+        search_index = old;
+        return -1;
+    }
+    search_index_size = oldsize * 2;
+    for (j = 0; j < oldsize; j++) {
+        size_t i;
+
+        if (!old[j].key)
+            continue;
+        for (i = gramBucket(old[j].key); search_index[i].key; i = (i + 1) & (search_index_size - 1))
+            ;
+        search_index[i] = old[j];
+    }
+    free(old);
+    return 0;
+}
+
+/* Add 'id' to the list of 'key', unless it is there already: the same gram
+ * may appear more than once in an entry. */
+static int gramListAdd(uint32_t key, uint32_t id) {
+    struct gramList *list = gramLookup(key);
+
+    if (list == NULL) {
+        size_t i;
+
+        if ((search_index_used + 1) * 4 > search_index_size * 3 && searchIndexGrow() == -1)
+            return -1;
+        for (i = gramBucket(key); search_index[i].key; i = (i + 1) & (search_index_size - 1))
+            ;
+        list = &search_index[i];
+        list->key = key;
+        search_index_used++;
+    }
+    if (list->len && list->ids[list->len - 1] == id)
+        return 0;
+    if (list->len == list->cap) {
+        uint32_t cap = list->cap ? list->cap * 2 : 4;
+        uint32_t *ids = realloc(list->ids, sizeof(uint32_t) * cap);
+
+        if (ids == NULL)
+            return -1;
+        list->ids = ids;
+        list->cap = cap;
+    }
+    list->ids[list->len++] = id;
+    return 0;
+}
+
+/* Add the id of 'e' to the list of every gram it contains. */
+static int searchIndexAdd(struct historyEntry *e) {
+    size_t j, n;
+
+    for (j = 0; j < e->len; j++) {
+        for (n = 1; n <= 3 && j + n <= e->len; n++) {
+            if (gramListAdd(gramKey(e->str + j, n), e->id) == -1)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static void searchIndexFree(void) {
+    size_t j;
+
+    for (j = 0; j < search_index_size; j++)
+        free(search_index[j].ids);
+    free(search_index);
+    search_index = NULL;
+    search_index_size = search_index_used = search_dead = 0;
+    search_next = 0;
+}
+
+/* Index up to 'count' more entries, oldest first. The index is complete
+ * once search_next reaches history_next_id. Returns -1 when out of memory,
+ * the index being dropped. */
+static int searchIndexStep(int count) {
+    int pos;
+
+    if (search_index == NULL) {
+        search_index = calloc(1024, sizeof(*search_index));
+        if (search_index == NULL)
+            return -1;
+        search_index_size = 1024;
+        search_next = 0;
+    }
+    for (pos = historyLowerBound(search_next); pos < history_len && count > 0; pos++, count--) {
+        struct historyEntry *e = &history[historySlot(pos)];
+
+        if (e->str != NULL && searchIndexAdd(e) == -1) {
+            searchIndexFree();
+            return -1;
+        }
+    }
+    search_next = pos < history_len ? history[historySlot(pos)].id : history_next_id;
+    return 0;
+}
+
+/* Build the index until it is complete or a key is waiting on 'fd'. */
+static void searchIndexIdle(int fd) {
+    while (history_len && (search_index == NULL || search_next != history_next_id) &&
+           !inputQueued(fd)) {
+        if (searchIndexStep(LINENOISE_SEARCH_STEP) == -1)
+            return;
+    }
+}
+
+/* Return the index of the first id not lower than 'id' in the sorted
+ * array 'ids' of 'n' elements, or 'n' if there is none. The search gallops
+ * back from the end, since the id looked for is usually close to it. */
+static size_t idLowerBound(const uint32_t *ids, size_t n, uint32_t id) {
+    size_t lo, hi = n, step = 1;
+
+    while (hi >= step && ids[hi - step] >= id) {
+        hi -= step;
+        step *= 2;
+    }
+    lo = hi >= step ? hi - step : 0;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (ids[mid] < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+#define LINENOISE_SEARCH_MAX_TRIGRAMS 64
+
+/* Find the newest entry containing 'query' whose id is lower than 'before'
+ * (0 for no limit). Returns its history index (1 is the newest entry) and
+ * sets '*id', or returns -1 if there is no match. */
+static int historySearch(const char *query, size_t qlen, uint32_t before, uint32_t *id) {
+    struct gramList *lists[LINENOISE_SEARCH_MAX_TRIGRAMS];
+    size_t ends[LINENOISE_SEARCH_MAX_TRIGRAMS];
+    struct historyEntry *e;
+    uint32_t oldest, candidate;
+    int nlists = 0, pos, k;
+    size_t j;
+
+    if (history_len == 0)
+        return -1;
+    if (before == 0)
+        before = history_next_id;
+
+    if ((search_index == NULL || search_next != history_next_id) &&
+        searchIndexStep(history_len) == -1)
+        return -1;
+    /* A query shorter than a trigram has a list of its own. */
+    for (j = 0; (j == 0 || j + 3 <= qlen) && nlists < LINENOISE_SEARCH_MAX_TRIGRAMS; j++) {
+        struct gramList *list = gramLookup(gramKey(query + j, qlen < 3 ? qlen : 3));
+
+        if (list == NULL)
+            return -1;
+        /* Keep the lists sorted by length, the shortest first. */
+        for (k = nlists++; k > 0 && lists[k - 1]->len > list->len; k--) {
+            lists[k] = lists[k - 1];
+            ends[k] = ends[k - 1];
+        }
+        lists[k] = list;
+        ends[k] = list->len;
+    }
+
+    /* Entries matching the query appear in every one of these lists. Walk
+     * the lists together, newest first: look for the candidate in each
+     * list, shortest first, and when a list does not have it, lower the
+     * candidate to the newest older id of that list and start again. Once all the lists have it the text of the entry is checked.
+     * Each list is only searched below the place it was last looked up at,
+     * and ids older than the oldest entry belong to evicted entries. */
+    oldest = history[history_start].id;
+    candidate = before - 1;
+    for (;;) {
+        for (k = 0; k < nlists; k++) {
+            ends[k] = idLowerBound(lists[k]->ids, ends[k], candidate + 1);
+            if (ends[k] == 0 || lists[k]->ids[ends[k] - 1] < oldest)
+                return -1;
+            if (lists[k]->ids[ends[k] - 1] != candidate) {
+                candidate = lists[k]->ids[ends[k] - 1];
+                break;
+            }
+        }
+        if (k < nlists)
+            continue;
+        pos = historyLowerBound(candidate);
+        e = &history[historySlot(pos)];
+        if (pos < history_len && e->id == candidate && e->str &&
+            memmem(e->str, e->len, query, qlen)) {
+            *id = e->id;
+            return history_len - pos;
+        }
+        if (candidate <= oldest)
+            return -1;
+        candidate--;
+    }
+}
+
+/* Create the temporary file a history file is rewritten into, readable by
+ * the user only. Its name, to be freed, is returned in 'tmpname'. */
+static FILE *historyTempOpen(const char *filename, char **tmpname) {
     mode_t old_umask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    size_t tmplen = strlen(filename) + 32;
     FILE *fp;
-    int j;
 
-    fp = fopen(filename, "w");
+    *tmpname = malloc(tmplen);
+    if (*tmpname == NULL) {
+        umask(old_umask);
+        return NULL;
+    }
+    snprintf(*tmpname, tmplen, "%s.tmp.%ld", filename, (long)getpid());
+    fp = fopen(*tmpname, "w");
     umask(old_umask);
+    if (fp == NULL) {
+        free(*tmpname);
+        return NULL;
+    }
+    fchmod(fileno(fp), S_IRUSR | S_IWUSR);
+    return fp;
+}
+
+/* Close the temporary file and rename it over the history file. Returns 0
+ * on success, -1 on error. */
+static int historyTempCommit(FILE *fp, char *tmpname, const char *filename) {
+    int ret = 0;
+
+    if (fclose(fp) == EOF || rename(tmpname, filename) == -1) {
+        unlink(tmpname);
+        ret = -1;
+    }
+    free(tmpname);
+    return ret;
+}
+
+/* Save the history in the specified file. On success 0 is returned
+ * otherwise -1 is returned.
+ *
+ * The history is written to a temporary file that is then renamed over
+ * the old one, so readers (and a concurrent linenoiseHistoryAppend()) never
+ * see a truncated file. */
+int linenoiseHistorySave(const char *filename) {
+    char *tmpname;
+    FILE *fp = historyTempOpen(filename, &tmpname);
+    int j;
+
     if (fp == NULL)
         return -1;
-    fchmod(fileno(fp), S_IRUSR | S_IWUSR);
-    for (j = 0; j < history_len; j++)
-        fprintf(fp, "%s\n", history[j]);
-    fclose(fp);
-    return 0;
+    for (j = 0; j < history_len; j++) {
+        struct historyEntry *e = &history[historySlot(j)];
+
+        if (e->str == NULL)
+            continue;
+        fwrite(e->str, 1, e->len, fp);
+        fputc('\n', fp);
+    }
+    return historyTempCommit(fp, tmpname, filename);
+}
+
+/* Open the history file with 'flags' and lock it, so that appending to it
+ * and compacting it in several shells at once do not lose lines. A
+ * compaction renames a new file over the one locked, so the lock only
+ * counts once the file locked is still the one named 'filename'. Returns
+ * the descriptor, or -1 on error. */
+static int historyLock(const char *filename, int flags) {
+    struct stat locked, named;
+
+    for (;;) {
+        int fd = open(filename, flags | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+        if (fd == -1)
+            return -1;
+        while (flock(fd, LOCK_EX) == -1) {
+            if (errno != EINTR) {
+                close(fd);
+                return -1;
+            }
+        }
+        if (fstat(fd, &locked) == -1) {
+            close(fd);
+            return -1;
+        }
+        if (stat(filename, &named) == 0 && named.st_dev == locked.st_dev &&
+            named.st_ino == locked.st_ino)
+            return fd;
+        close(fd);
+    }
+}
+
+/* Append a single line to the history file with one O_APPEND write, so
+ * that recording a command costs O(1) I/O instead of rewriting the whole
+ * file like linenoiseHistorySave() does. If the file does not end with a
+ * newline (it was edited by hand) one is written first. On success 0 is
+ * returned otherwise -1 is returned. */
+int linenoiseHistoryAppend(const char *filename, const char *line) {
+    size_t len = strlen(line);
+    char stackbuf[LINENOISE_MAX_LINE];
+    char *buf = len + 2 <= sizeof(stackbuf) ? stackbuf : malloc(len + 2);
+    size_t buflen = 0;
+    struct stat st;
+    ssize_t nwritten;
+    char last;
+    int fd;
+
+    if (buf == NULL)
+        return -1;
+    fd = historyLock(filename, O_RDWR | O_APPEND | O_CREAT);
+    if (fd == -1) {
+        if (buf != stackbuf)
+            free(buf);
+        return -1;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+        pread(fd, &last, 1, st.st_size - 1) == 1 && last != '\n')
+        buf[buflen++] = '\n';
+    memcpy(buf + buflen, line, len);
+    buflen += len;
+    buf[buflen++] = '\n';
+    nwritten = write(fd, buf, buflen);
+    close(fd);
+    if (buf != stackbuf)
+        free(buf);
+    return nwritten == (ssize_t)buflen ? 0 : -1;
+}
+
+/* Read 'len' bytes of 'fd' at 'offset' into 'buf'. Returns the number of
+ * bytes read, less if the file got shorter, or -1 on error. */
+static ssize_t historyRead(int fd, char *buf, size_t len, off_t offset) {
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, offset + done);
+
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        if (n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+/* Read the end of the history file 'fd', 'size' bytes long, holding its
+ * last history_max_len lines into a chunk of its own, one byte longer to
+ * terminate a last line without a newline. The part read is doubled until
+ * the oldest line kept starts inside it. The lines are returned between
+ * 'start' and 'end'; returns the chunk, or NULL on error. */
+static struct historyChunk *historyReadTail(int fd, off_t size, char **start, char **end) {
+    struct historyChunk *c = NULL, *grown;
+    size_t want = LINENOISE_HISTORY_CHUNK_SIZE;
+    ssize_t got;
+    off_t offset;
+    char *data, *p;
+    int lines;
+
+    for (;;) {
+        if (want > (size_t)size)
+            want = size;
+        offset = size - want;
+        grown = realloc(c, sizeof(*c) + want + 1);
+        if (grown == NULL) {
+            free(c);
+            return NULL;
+        }
+        c = grown;
+        got = historyRead(fd, c->data, want, offset);
+        if (got == -1) {
+            free(c);
+            return NULL;
+        }
+
+        /* Walk back to the start of the oldest line that still fits. */
+        data = c->data;
+        p = data + got;
+        lines = 0;
+        while (p > data && lines < history_max_len) {
+            char *eol = p[-1] == '\n' ? p - 1 : p;
+            char *nl = memrchr(data, '\n', eol - data);
+            char *line = nl ? nl + 1 : data;
+
+            if (eol > line)
+                lines++;
+            p = line;
+        }
+        /* Done unless that line may start before what was read. */
+        if (offset == 0 || p > data)
+            break;
+        want *= 2;
+    }
+    c->used = c->size = want + 1;
+    c->live = 0;
+    *start = p;
+    *end = data + got;
+    return c;
+}
+
+/* Rewrite the history file if appending made it grow well past what the
+ * history holds, keeping only its last history_max_len lines. The lines
+ * are taken from the file rather than from the history in memory, so the
+ * ones other shells appended since this one started are kept, and the
+ * file is locked while it is rewritten. Returns 1 if the file was
+ * compacted, 0 if it was left alone and -1 on error. */
+int linenoiseHistoryCompact(const char *filename) {
+    struct historyChunk *c;
+    struct stat st;
+    char *start, *end, *tmpname;
+    FILE *fp;
+    int fd, ret = 0;
+
+    if (history_max_len == 0 || stat(filename, &st) == -1 ||
+        st.st_size < LINENOISE_COMPACT_MIN_SIZE)
+        return 0;
+    fd = historyLock(filename, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, &st) == -1 || (c = historyReadTail(fd, st.st_size, &start, &end)) == NULL) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size >= LINENOISE_COMPACT_MIN_SIZE && (size_t)st.st_size > (size_t)(end - start) * 2) {
+        fp = historyTempOpen(filename, &tmpname);
+        ret = -1;
+        if (fp != NULL) {
+            fwrite(start, 1, end - start, fp);
+            if (end > start && end[-1] != '\n')
+                fputc('\n', fp);
+            if (historyTempCommit(fp, tmpname, filename) == 0)
+                ret = 1;
+        }
+    }
+    free(c);
+    /* Closing the descriptor releases the lock. */
+    close(fd);
+    return ret;
 }
 
 /* Load the history from the specified file. If the file does not exist
- * zero is returned and no operation is performed.
+ * -1 is returned and no operation is performed.
+ *
+ * Only the end of the file holding its last history_max_len lines is read,
+ * into a chunk of its own that the entries point into. Loading costs the
+ * same whatever the size of the file, and the entries do not depend on the
+ * file once loaded, whatever happens to it afterwards.
  *
  * If the file exists and the operation succeeded 0 is returned, otherwise
  * on error -1 is returned. */
 int linenoiseHistoryLoad(const char *filename) {
-    FILE *fp = fopen(filename, "r");
-    char buf[LINENOISE_MAX_LINE];
+    struct historyChunk *c;
+    struct stat st;
+    char *p, *end;
+    int fd;
 
-    if (fp == NULL)
+    if (history_max_len == 0)
+        return 0;
+    fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
         return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    c = historyReadTail(fd, st.st_size, &p, &end);
+    close(fd);
+    if (c == NULL)
+        return -1;
+
+    /* The set is built again, dropping the copies, on the next add. */
+    historySetFree();
 
-    while (fgets(buf, LINENOISE_MAX_LINE, fp) != NULL) {
-        char *p;
+    /* Index the lines from there on, oldest first. */
+    while (p < end) {
+        char *nl = memchr(p, '\n', end - p);
+        char *eol = nl ? nl : end;
+        char *cr = memchr(p, '\r', eol - p);
 
-        p = strchr(buf, '\r');
-        if (!p)
-            p = strchr(buf, '\n');
-        if (p)
-            *p = '\0';
-        linenoiseHistoryAdd(buf);
+        if (cr)
+            eol = cr;
+        if (eol > p) {
+            if (historyReserve() == -1)
+                break;
+            *eol = '\0';
+            c->live++;
+            historyPush(p, eol - p, c);
+        }
+        p = nl ? nl + 1 : end;
     }
-    fclose(fp);
-    return 0;
+    if (c->live == 0)
+        free(c);
+    return p < end ? -1 : 0;
 }
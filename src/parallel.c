@@ -0,0 +1,471 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#define _GNU_SOURCE
+
+#include "libs/parallel.h"
+#include "libs/builtins.h"
+#include "libs/jobs.h"
+#include "libs/launch.h"
+#include "libs/path_hash.h"
+#include "libs/utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_FAILED 100
+
+/* A worker slot runs one command at a time. Its stdout and stderr go to two
+ * unnamed temporary files rather than pipes: the command never blocks on a
+ * full pipe while another one has the output, and when it exits the files
+ * are copied out in one go with sendfile(), without passing through the
+ * shell's memory. They are then emptied for the next command of the slot.
+ * The files live in $TMPDIR, so a command printing more than fits in memory
+ * has its output written out to disk. */
+struct slot {
+    pid_t pid;  // 0 while the slot is free
+    int number; // Which argument it runs, from 1
+    int out;    // Captured stdout, -1 until the slot is first used
+    int err;    // Captured stderr
+    char *command;
+    struct timespec start;
+};
+
+/* The arguments the command runs with: the words after ":::", or the lines
+ * of stdin, which then live in 'data'. */
+struct arg_list {
+    char **items;
+    int count;
+    char *data;
+    char **lines;
+};
+
+static int usage(void) {
+    fprintf(stderr, NSH_ERR "usage: parallel [-j N] command [args...] [::: arg...]\n" NSH_RESET);
+    return 2;
+}
+
+// Take the non-empty lines of stdin as the arguments
+static int read_args(struct arg_list *args) {
+    size_t len = 0, size = 4096;
+    int max = 0;
+    ssize_t n;
+
+    args->data = malloc(size);
+    if (args->data == NULL) {
+        return -1;
+    }
+    while ((n = read(STDIN_FILENO, args->data + len, size - len - 1)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror(NSH_ERR "parallel" NSH_RESET);
+            return -1;
+        }
+        len += n;
+        if (size - len == 1) {
+            char *bigger = realloc(args->data, size * 2);
+            if (bigger == NULL) {
+                return -1;
+            }
+            args->data = bigger;
+            size *= 2;
+        }
+    }
+    args->data[len] = '\0';
+
+    for (char *line = args->data; line != NULL;) {
+        char *next = strchr(line, '\n');
+
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        line[strcspn(line, "\r")] = '\0';
+        if (*line != '\0') {
+            if (args->count == max) {
+                max = max ? max * 2 : 64;
+                char **more = realloc(args->lines, max * sizeof(char *));
+                if (more == NULL) {
+                    return -1;
+                }
+                args->lines = more;
+            }
+            args->lines[args->count++] = line;
+        }
+        line = next;
+    }
+    args->items = args->lines;
+    return 0;
+}
+
+// 'word' with every "{}" replaced by 'arg'
+static char *expand(const char *word, const char *arg) {
+    size_t arg_len = strlen(arg), len = 0;
+    const char *p;
+    char *result;
+
+    for (p = word; *p; p++) {
+        len += (p[0] == '{' && p[1] == '}') ? (p++, arg_len) : 1;
+    }
+    if ((result = malloc(len + 1)) == NULL) {
+        return NULL;
+    }
+    len = 0;
+    for (p = word; *p; p++) {
+        if (p[0] == '{' && p[1] == '}') {
+            memcpy(result + len, arg, arg_len);
+            len += arg_len;
+            p++;
+        } else {
+            result[len++] = *p;
+        }
+    }
+    result[len] = '\0';
+    return result;
+}
+
+static void free_argv(char **argv) {
+    for (int i = 0; argv[i] != NULL; i++) {
+        free(argv[i]);
+    }
+    free(argv);
+}
+
+// The command line for one argument: the template with "{}" filled in, or
+// the argument added at the end if the template has no "{}"
+static char **build_argv(char **words, int count, int placeholder, const char *arg) {
+    char **argv = calloc(count + 2, sizeof(char *));
+
+    if (argv == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        if ((argv[i] = expand(words[i], arg)) == NULL) {
+            free_argv(argv);
+            return NULL;
+        }
+    }
+    if (!placeholder && (argv[count] = strdup(arg)) == NULL) {
+        free_argv(argv);
+        return NULL;
+    }
+    return argv;
+}
+
+static char *join(char **argv) {
+    size_t len = 0;
+    char *text;
+
+    for (int i = 0; argv[i] != NULL; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    if ((text = malloc(len + 1)) == NULL) {
+        return NULL;
+    }
+    len = 0;
+    for (int i = 0; argv[i] != NULL; i++) {
+        len += sprintf(text + len, i ? " %s" : "%s", argv[i]);
+    }
+    text[len] = '\0';
+    return text;
+}
+
+// Copy what a command wrote to 'from' out to 'to', and empty 'from'
+static void copy_output(int from, int to) {
+    struct stat st;
+    off_t offset = 0;
+
+    if (fstat(from, &st) == -1) {
+        return;
+    }
+    while (offset < st.st_size) {
+        ssize_t n = sendfile(to, from, &offset, st.st_size - offset);
+
+        if (n == -1 && (errno == EINVAL || errno == ENOSYS)) {
+            // e.g. an O_APPEND file on an older kernel: copy by hand
+            char buf[65536];
+
+            while ((n = pread(from, buf, sizeof(buf), offset)) > 0) {
+                for (ssize_t done = 0, w; done < n; done += w) {
+                    if ((w = write(to, buf + done, n - done)) == -1) {
+                        goto empty;
+                    }
+                }
+                offset += n;
+            }
+            break;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+    }
+
+empty:
+    if (ftruncate(from, 0) == 0) {
+        lseek(from, 0, SEEK_SET);
+    }
+}
+
+// An unnamed file in $TMPDIR for the output of a command, or a memfd if the
+// file system there has no unnamed files
+static int capture_file(const char *name) {
+    const char *dir = getenv("TMPDIR");
+    int fd = open(dir != NULL && *dir != '\0' ? dir : "/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC,
+                  S_IRUSR | S_IWUSR);
+
+    if (fd == -1) {
+        fd = memfd_create(name, MFD_CLOEXEC);
+    }
+    return fd;
+}
+
+static int open_capture(struct slot *s) {
+    if (s->out == -1) {
+        s->out = capture_file("nsh-parallel-out");
+        s->err = capture_file("nsh-parallel-err");
+        if (s->out == -1 || s->err == -1) {
+            perror(NSH_ERR "parallel: capture file" NSH_RESET);
+            if (s->out != -1) {
+                close(s->out);
+            }
+            if (s->err != -1) {
+                close(s->err);
+            }
+            s->out = s->err = -1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Print the captured output of a command that ended, then how it went
+static void finish(struct slot *s, int wstatus) {
+    struct timespec end;
+    char desc[64];
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (s->out != -1) {
+        copy_output(s->out, STDOUT_FILENO);
+        copy_output(s->err, STDERR_FILENO);
+    }
+
+    if (WIFSIGNALED(wstatus)) {
+        snprintf(desc, sizeof(desc), "%s", strsignal(WTERMSIG(wstatus)));
+    } else if (WEXITSTATUS(wstatus) != 0) {
+        snprintf(desc, sizeof(desc), "Exit %d", WEXITSTATUS(wstatus));
+    } else {
+        strcpy(desc, "Done");
+    }
+    fprintf(stderr, "[%d] %-10s %8.3fs  %s\n", s->number, desc,
+            (end.tv_sec - s->start.tv_sec) + (end.tv_nsec - s->start.tv_nsec) / 1e9,
+            s->command ? s->command : "");
+    free(s->command);
+    s->command = NULL;
+    s->pid = 0;
+}
+
+// Start the command for argument number 'number' in the free slot 's'.
+// Returns -1 if the slot could not be set up, 0 otherwise, even when the
+// command itself could not be started: that counts as a failed run.
+static int start(struct slot *s, char **argv, int number, int devnull) {
+    struct launch_options opts = {.pgid = -1};
+
+    if (open_capture(s) == -1) {
+        return -1;
+    }
+    // Workers stay in the shell's process group: Ctrl-C reaches them all
+    opts.fds[opts.fd_count].from = devnull;
+    opts.fds[opts.fd_count++].to = STDIN_FILENO;
+    opts.fds[opts.fd_count].from = s->out;
+    opts.fds[opts.fd_count++].to = STDOUT_FILENO;
+    opts.fds[opts.fd_count].from = s->err;
+    opts.fds[opts.fd_count++].to = STDERR_FILENO;
+
+    s->number = number;
+    s->command = join(argv);
+    clock_gettime(CLOCK_MONOTONIC, &s->start);
+    s->pid = launch_command(argv, &opts);
+    if (s->pid < 0) {
+        dprintf(s->err, "nsh: %s: %s\n", argv[0], strerror(errno));
+        finish(s, W_EXITCODE(127, 0));
+    }
+    return 0;
+}
+
+// Collect the slots whose command ended. Returns how many failed, or -1 if
+// none ended at all.
+static int reap_slots(struct slot *slots, long count, int *running) {
+    int failed = -1;
+
+    for (long i = 0; i < count; i++) {
+        struct slot *s = &slots[i];
+        int wstatus = 0;
+        pid_t pid;
+
+        if (s->pid <= 0) {
+            continue;
+        }
+        while ((pid = waitpid(s->pid, &wstatus, WNOHANG | WUNTRACED)) == -1 && errno == EINTR) {
+        }
+        if (pid == 0) {
+            continue;
+        }
+        if (pid > 0 && WIFSTOPPED(wstatus)) {
+            // Nobody could resume it from the job table: keep it going
+            kill(s->pid, SIGCONT);
+            continue;
+        }
+        if (failed == -1) {
+            failed = 0;
+        }
+        failed += (pid > 0 && wstatus != 0);
+        finish(s, pid > 0 ? wstatus : 0);
+        (*running)--;
+    }
+    return failed;
+}
+
+int parallel_run(int argc, char **argv) {
+    struct arg_list args = {0};
+    struct slot *slots;
+    long max = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1, sep, next = 0, running = 0, failed = 0, interrupted = 0;
+    int placeholder = 0;
+    long slot_count;
+    int devnull;
+
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "--") == 0) {
+            first++;
+            break;
+        }
+        if (strncmp(argv[first], "-j", 2) != 0) {
+            return usage();
+        }
+        const char *value = argv[first][2] ? argv[first] + 2 : (first + 1 < argc ? argv[++first] : "");
+        char *end;
+        max = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || max <= 0) {
+            return usage();
+        }
+        first++;
+    }
+    for (sep = first; sep < argc && strcmp(argv[sep], ":::") != 0; sep++) {
+        placeholder |= strstr(argv[sep], "{}") != NULL;
+    }
+    if (sep == first) {
+        return usage();
+    }
+    // A builtin also found on $PATH (echo, pwd) runs as that program
+    if (builtin_lookup(argv[first]) != NULL && path_hash_lookup(argv[first]) == NULL) {
+        fprintf(stderr, NSH_ERR "parallel: %s: cannot run a builtin\n" NSH_RESET, argv[first]);
+        return 2;
+    }
+
+    if (sep < argc) {
+        args.items = &argv[sep + 1];
+        args.count = argc - sep - 1;
+    } else if (read_args(&args) == -1) {
+        free(args.data);
+        free(args.lines);
+        return 1;
+    }
+    if (max > args.count) {
+        max = args.count;
+    }
+    slot_count = max;
+    slots = calloc(max ? max : 1, sizeof(*slots));
+    devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (slots == NULL || devnull == -1) {
+        perror(NSH_ERR "parallel" NSH_RESET);
+        free(slots);
+        free(args.data);
+        free(args.lines);
+        return 1;
+    }
+    for (long i = 0; i < slot_count; i++) {
+        slots[i].out = slots[i].err = -1;
+    }
+    fflush(stdout);
+
+    while (next < args.count || running > 0) {
+        while (!interrupted && next < args.count && running < max) {
+            struct slot *s = slots;
+            char **cmd = build_argv(&argv[first], sep - first, placeholder, args.items[next]);
+
+            while (s->pid != 0) {
+                s++;
+            }
+            if (cmd == NULL || start(s, cmd, next + 1, devnull) == -1) {
+                // Out of descriptors or memory: make do with the slots in use
+                if (cmd != NULL) {
+                    free_argv(cmd);
+                }
+                max = running;
+                break;
+            }
+            free_argv(cmd);
+            next++;
+            if (s->pid > 0) {
+                running++;
+            } else {
+                failed++;
+            }
+        }
+        if (running == 0) {
+            if (next < args.count && !interrupted) {
+                failed += args.count - next; // Nothing could be started
+            }
+            break;
+        }
+
+        int ended = reap_slots(slots, slot_count, &running);
+        if (ended >= 0) {
+            failed += ended;
+        } else if (jobs_wait_event(-1, -1) == -1 && !interrupted) {
+            // Ctrl-C: start nothing more, and stop the commands that
+            // survived it
+            interrupted = 1;
+            printf("\n");
+            fflush(stdout);
+            for (long i = 0; i < slot_count; i++) {
+                if (slots[i].pid > 0) {
+                    kill(slots[i].pid, SIGTERM);
+                }
+            }
+        }
+    }
+
+    for (long i = 0; i < slot_count; i++) {
+        if (slots[i].out != -1) {
+            close(slots[i].out);
+            close(slots[i].err);
+        }
+    }
+    close(devnull);
+    free(args.data);
+    free(args.lines);
+    free(slots);
+    if (interrupted) {
+        return 130;
+    }
+    return failed > MAX_FAILED ? MAX_FAILED : failed;
+}
@@ -0,0 +1,522 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#include "libs/parser.h"
+#include "libs/jobs.h"
+#include "libs/script.h"
+#include "libs/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Where a command of the pipeline starts in the word and redirection
+ * arrays. */
+struct parse_stage {
+    int word;
+    int redirect;
+};
+
+/* A redirection, and the word holding its file name. */
+struct parse_redirect {
+    struct redirect r;
+    size_t word;
+};
+
+/* Words are built one after the other in a single growing buffer. Their
+ * start offsets are recorded and turned into argv pointers at the end,
+ * once the buffer no longer moves. */
+struct parse_state {
+    const char *p;    // Next input character
+    char *buf;        // Word storage
+    size_t len, cap;
+    size_t *starts;   // Start offset of each finished word
+    int count, max;
+    struct parse_stage *stages;
+    int stage_count, stage_max;
+    int stage_used;   // The current command has seen something besides blanks
+    struct parse_redirect *redirects;
+    int redirect_count, redirect_max;
+    int pending;      // 1 + index of the redirection waiting for its file name
+    int background;   // The line ended with '&'
+    size_t word;      // Start offset of the word being built
+    int in_word;      // A word has been started (possibly still empty)
+    int drop_empty;   // Drop the word if it ends up empty ("$@", no args)
+    int plain;        // The word has no quotes, escapes or expansions
+    const char *error;
+};
+
+static int put_char(struct parse_state *ps, char c) {
+    if (ps->len + 1 >= ps->cap) {
+        size_t cap = ps->cap ? ps->cap * 2 : 128;
+        char *buf = realloc(ps->buf, cap);
+        if (buf == NULL) {
+            ps->error = "out of memory";
+            return -1;
+        }
+        ps->buf = buf;
+        ps->cap = cap;
+    }
+    ps->buf[ps->len++] = c;
+    return 0;
+}
+
+static int put_string(struct parse_state *ps, const char *s) {
+    while (*s) {
+        if (put_char(ps, *s++) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int end_word(struct parse_state *ps) {
+    if (!ps->in_word) {
+        return 0;
+    }
+    if (ps->drop_empty && ps->len == ps->word) {
+        ps->in_word = ps->drop_empty = 0;
+        return 0;
+    }
+    ps->drop_empty = 0;
+    if (put_char(ps, '\0') == -1) {
+        return -1;
+    }
+    ps->in_word = 0;
+    if (ps->pending) {
+        ps->redirects[ps->pending - 1].word = ps->word;
+        ps->pending = 0;
+        return 0;
+    }
+    if (ps->count == ps->max) {
+        int max = ps->max ? ps->max * 2 : 16;
+        size_t *starts = realloc(ps->starts, max * sizeof(*starts));
+        if (starts == NULL) {
+            ps->error = "out of memory";
+            return -1;
+        }
+        ps->starts = starts;
+        ps->max = max;
+    }
+    ps->starts[ps->count++] = ps->word;
+    return 0;
+}
+
+static void begin_word(struct parse_state *ps) {
+    if (!ps->in_word) {
+        ps->word = ps->len;
+        ps->in_word = 1;
+        ps->plain = 1;
+    }
+}
+
+static int is_name_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int is_name_char(char c) {
+    return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+// Expand "$@": every positional parameter becomes a word of its own, the
+// first one joined to the text before it and the last one to the text after
+static int expand_all_args(struct parse_state *ps) {
+    int count = script_arg_count();
+
+    if (count == 0) {
+        ps->drop_empty = 1;
+    }
+    for (int i = 1; i <= count; i++) {
+        if (i > 1) {
+            if (end_word(ps) == -1) {
+                return -1;
+            }
+            begin_word(ps);
+        }
+        if (put_string(ps, script_arg(i)) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Expand the parameter following a '$'. 'ps->p' points just after the '$'.
+static int expand_dollar(struct parse_state *ps, int quoted) {
+    char name[256];
+    size_t len = 0;
+    const char *p = ps->p;
+    char special = 0;
+
+    if (*p == '{') {
+        p++;
+        if (*p == '#' || *p == '?' || *p == '@' || *p == '*' || *p == '!') {
+            special = *p++;
+        } else {
+            while (is_name_char(*p) && len < sizeof(name) - 1) {
+                name[len++] = *p++;
+            }
+        }
+        if (*p != '}' || (len == 0 && !special)) {
+            ps->error = "unsupported ${...} expansion";
+            return PARSE_UNSUPPORTED;
+        }
+        p++;
+    } else if (*p == '#' || *p == '?' || *p == '@' || *p == '*' || *p == '!') {
+        special = *p++;
+    } else if (*p >= '0' && *p <= '9') {
+        name[len++] = *p++;
+    } else if (is_name_start(*p)) {
+        while (is_name_char(*p) && len < sizeof(name) - 1) {
+            name[len++] = *p++;
+        }
+    } else if (*p == '(' || *p == '$' || *p == '-') {
+        ps->error = "unsupported $ expansion";
+        return PARSE_UNSUPPORTED;
+    } else {
+        // A lone '$' stands for itself
+        ps->p = p;
+        return put_char(ps, '$');
+    }
+    name[len] = '\0';
+    ps->p = p;
+
+    if (special == '@' || (special == '*' && !quoted)) {
+        return expand_all_args(ps);
+    }
+    if (special == '*') {
+        for (int i = 1; i <= script_arg_count(); i++) {
+            if ((i > 1 && put_char(ps, ' ') == -1) || put_string(ps, script_arg(i)) == -1) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    if (special == '!') {
+        // The last command started in the background, nothing before that
+        char number[16];
+        pid_t pid = jobs_last_pid();
+        if (pid > 0) {
+            snprintf(number, sizeof(number), "%d", (int)pid);
+            return put_string(ps, number);
+        }
+        return 0;
+    }
+    if (special == '#' || special == '?') {
+        char number[16];
+        snprintf(number, sizeof(number), "%d",
+                 special == '#' ? script_arg_count() : last_exit_status());
+        return put_string(ps, number);
+    }
+    if (name[0] >= '0' && name[0] <= '9') {
+        return put_string(ps, script_arg(atoi(name)));
+    }
+
+    const char *value = getenv(name);
+    return value ? put_string(ps, value) : 0;
+}
+
+static int parse_double_quoted(struct parse_state *ps) {
+    int ret;
+
+    for (;;) {
+        char c = *ps->p;
+        if (c == '\0') {
+            ps->error = "unterminated double quote";
+            return PARSE_ERROR;
+        }
+        ps->p++;
+        if (c == '"') {
+            return 0;
+        } else if (c == '\\' && (*ps->p == '$' || *ps->p == '`' || *ps->p == '"' || *ps->p == '\\')) {
+            ret = put_char(ps, *ps->p++);
+        } else if (c == '$') {
+            ret = expand_dollar(ps, 1);
+        } else if (c == '`') {
+            ps->error = "command substitution is not supported";
+            return PARSE_UNSUPPORTED;
+        } else {
+            ret = put_char(ps, c);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+    }
+}
+
+// Start the next command of the pipeline at the current word
+static int begin_stage(struct parse_state *ps) {
+    if (ps->stage_count == ps->stage_max) {
+        int max = ps->stage_max ? ps->stage_max * 2 : 4;
+        struct parse_stage *stages = realloc(ps->stages, max * sizeof(*stages));
+        if (stages == NULL) {
+            ps->error = "out of memory";
+            return -1;
+        }
+        ps->stages = stages;
+        ps->stage_max = max;
+    }
+    ps->stages[ps->stage_count].word = ps->count;
+    ps->stages[ps->stage_count++].redirect = ps->redirect_count;
+    ps->stage_used = 0;
+    return 0;
+}
+
+static int add_redirect(struct parse_state *ps, int type, int fd, int dup_fd) {
+    if (ps->redirect_count == ps->redirect_max) {
+        int max = ps->redirect_max ? ps->redirect_max * 2 : 4;
+        struct parse_redirect *redirects = realloc(ps->redirects, max * sizeof(*redirects));
+        if (redirects == NULL) {
+            ps->error = "out of memory";
+            return -1;
+        }
+        ps->redirects = redirects;
+        ps->redirect_max = max;
+    }
+    struct parse_redirect *pr = &ps->redirects[ps->redirect_count++];
+    pr->r.type = type;
+    pr->r.fd = fd;
+    pr->r.dup_fd = dup_fd;
+    pr->r.path = NULL;
+    pr->word = 0;
+    if (type != REDIRECT_DUP) {
+        ps->pending = ps->redirect_count;
+    }
+    return 0;
+}
+
+// Parse the redirection operator at 'ps->p'. A single digit written right
+// before it is the descriptor to redirect, as in "2>file". The file name is
+// the next word.
+static int parse_redirect(struct parse_state *ps) {
+    const char *p = ps->p;
+    int both = (*p == '&'); // &> and &>> redirect stdout and stderr
+    int type, fd = -1, dup_fd = -1;
+    int ret;
+
+    if (!both && !ps->pending && ps->in_word && ps->plain && ps->len == ps->word + 1 &&
+        ps->buf[ps->word] >= '0' && ps->buf[ps->word] <= '9') {
+        fd = ps->buf[ps->word] - '0';
+        ps->len = ps->word;
+        ps->in_word = 0;
+    } else if ((ret = end_word(ps)) != 0) {
+        return ret;
+    }
+    if (ps->pending) {
+        ps->error = "syntax error: missing file name after redirection";
+        return PARSE_ERROR;
+    }
+    p += both;
+
+    if (*p == '<') {
+        if (p[1] == '<' || p[1] == '>' || p[1] == '&') {
+            ps->error = "here-documents and <>, <& redirections are not supported";
+            return PARSE_UNSUPPORTED;
+        }
+        type = REDIRECT_IN;
+        p++;
+    } else if (p[1] == '>') {
+        type = REDIRECT_APPEND;
+        p += 2;
+    } else if (p[1] == '&' && !both) {
+        if (p[2] < '0' || p[2] > '9' || (p[3] >= '0' && p[3] <= '9')) {
+            ps->error = "only >&N with a descriptor 0-9 is supported";
+            return PARSE_UNSUPPORTED;
+        }
+        type = REDIRECT_DUP;
+        dup_fd = p[2] - '0';
+        p += 3;
+    } else if (p[1] == '|') {
+        ps->error = ">| is not supported";
+        return PARSE_UNSUPPORTED;
+    } else {
+        type = REDIRECT_OUT;
+        p++;
+    }
+    ps->p = p;
+    if (fd == -1) {
+        fd = (type == REDIRECT_IN) ? 0 : 1;
+    }
+    if (add_redirect(ps, type, fd, dup_fd) == -1) {
+        return -1;
+    }
+    return both ? add_redirect(ps, REDIRECT_DUP, 2, 1) : 0;
+}
+
+static int parse_words(struct parse_state *ps) {
+    int ret = begin_stage(ps);
+
+    while (ret == 0 && *ps->p != '\0') {
+        char c = *ps->p;
+
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            ps->p++;
+            ret = end_word(ps);
+            continue;
+        }
+        if (c == '#' && !ps->in_word) {
+            // Comment until the end of the line
+            break;
+        }
+        if (c == '|' && ps->p[1] != '|' && ps->p[1] != '&') {
+            if (!ps->stage_used || ps->pending) {
+                ps->error = "syntax error near '|'";
+                return PARSE_ERROR;
+            }
+            ps->p++;
+            if ((ret = end_word(ps)) == 0) {
+                ret = begin_stage(ps);
+            }
+            continue;
+        }
+
+        if (c == '&' && ps->p[1] != '&' && ps->p[1] != '>') {
+            // Run in the background: only blanks or a comment may follow
+            const char *rest = ps->p + 1 + strspn(ps->p + 1, " \t\r\n");
+            if (*rest != '\0' && *rest != '#') {
+                ps->error = "command lists are not supported";
+                return PARSE_UNSUPPORTED;
+            }
+            if (!ps->stage_used || ps->pending) {
+                ps->error = "syntax error near '&'";
+                return PARSE_ERROR;
+            }
+            ps->background = 1;
+            break;
+        }
+
+        ps->stage_used = 1;
+        if (c == '<' || c == '>' || (c == '&' && ps->p[1] == '>')) {
+            ret = parse_redirect(ps);
+        } else if (strchr("|&;()`", c) != NULL) {
+            ps->error = "command lists are not supported";
+            return PARSE_UNSUPPORTED;
+        } else if (c == '\\') {
+            ps->p++;
+            if (*ps->p == '\0') {
+                ps->error = "line continuation is not supported";
+                return PARSE_UNSUPPORTED;
+            }
+            begin_word(ps);
+            ps->plain = 0;
+            ret = put_char(ps, *ps->p++);
+        } else if (c == '\'') {
+            const char *end = strchr(ps->p + 1, '\'');
+            if (end == NULL) {
+                ps->error = "unterminated single quote";
+                return PARSE_ERROR;
+            }
+            begin_word(ps);
+            ps->plain = 0;
+            for (const char *q = ps->p + 1; q < end && ret == 0; q++) {
+                ret = put_char(ps, *q);
+            }
+            ps->p = end + 1;
+        } else if (c == '"') {
+            ps->p++;
+            begin_word(ps);
+            ps->plain = 0;
+            ret = parse_double_quoted(ps);
+        } else if (c == '$') {
+            size_t before = ps->len;
+            int started = ps->in_word;
+
+            ps->p++;
+            begin_word(ps);
+            ps->plain = 0;
+            ret = expand_dollar(ps, 0);
+            // An unquoted expansion that produced nothing is not a word
+            if (ret == 0 && !started && ps->len == before) {
+                ps->in_word = 0;
+            }
+        } else {
+            begin_word(ps);
+            ret = put_char(ps, c);
+            ps->p++;
+        }
+    }
+    if (ret == 0 && ps->stage_count > 1 && !ps->stage_used) {
+        ps->error = "syntax error: missing command after '|'";
+        return PARSE_ERROR;
+    }
+    if (ret == 0 && (ret = end_word(ps)) == 0 && ps->pending) {
+        ps->error = "syntax error: missing file name after redirection";
+        return PARSE_ERROR;
+    }
+    return ret;
+}
+
+int parse_pipeline(const char *line, struct pipeline *pl) {
+    struct parse_state ps = {0};
+    int ret;
+
+    memset(pl, 0, sizeof(*pl));
+    ps.p = line;
+    ret = parse_words(&ps);
+    if (ret == 0) {
+        pl->commands = malloc(ps.stage_count * sizeof(struct command));
+        pl->argvs = malloc((ps.count + ps.stage_count) * sizeof(char *));
+        pl->redirects = malloc((ps.redirect_count + 1) * sizeof(struct redirect));
+        if (pl->commands == NULL || pl->argvs == NULL || pl->redirects == NULL) {
+            ps.error = "out of memory";
+            ret = PARSE_ERROR;
+        }
+    }
+    if (ret != 0) {
+        free(ps.buf);
+        free(ps.starts);
+        free(ps.stages);
+        free(ps.redirects);
+        pl->error = ps.error;
+        return ret < 0 && ret != PARSE_UNSUPPORTED ? PARSE_ERROR : ret;
+    }
+
+    // Each argv is followed by its NULL terminator in 'argvs'
+    char **argv = pl->argvs;
+    for (int i = 0; i < ps.stage_count; i++) {
+        int last = (i + 1 == ps.stage_count);
+        int end = last ? ps.count : ps.stages[i + 1].word;
+        int redirect_end = last ? ps.redirect_count : ps.stages[i + 1].redirect;
+        struct command *cmd = &pl->commands[i];
+
+        cmd->argv = argv;
+        cmd->argc = end - ps.stages[i].word;
+        for (int w = ps.stages[i].word; w < end; w++) {
+            *argv++ = ps.buf + ps.starts[w];
+        }
+        *argv++ = NULL;
+        cmd->redirects = pl->redirects + ps.stages[i].redirect;
+        cmd->redirect_count = redirect_end - ps.stages[i].redirect;
+    }
+    for (int r = 0; r < ps.redirect_count; r++) {
+        pl->redirects[r] = ps.redirects[r].r;
+        if (pl->redirects[r].type != REDIRECT_DUP) {
+            pl->redirects[r].path = ps.buf + ps.redirects[r].word;
+        }
+    }
+    pl->words = ps.buf;
+    pl->background = ps.background;
+    pl->line = line;
+    // A single command whose words all expanded to nothing is not run,
+    // unless it has redirections: "> file" still creates the file
+    pl->count = (ps.stage_count == 1 && ps.count == 0 && ps.redirect_count == 0) ? 0 : ps.stage_count;
+    free(ps.starts);
+    free(ps.stages);
+    free(ps.redirects);
+    return pl->count;
+}
+
+void free_pipeline(struct pipeline *pl) {
+    free(pl->commands);
+    free(pl->argvs);
+    free(pl->redirects);
+    free(pl->words);
+    pl->commands = NULL;
+    pl->argvs = NULL;
+    pl->redirects = NULL;
+    pl->words = NULL;
+    pl->count = 0;
+}
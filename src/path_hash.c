@@ -0,0 +1,290 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#include "libs/path_hash.h"
+#include "libs/utils.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct path_dir {
+    char *name;            // Directory as written in $PATH ("" means ".")
+    struct timespec mtime; // Modification time when it was last checked
+    int exists;            // Whether stat() succeeded at that time
+};
+
+struct hash_entry {
+    char *name;  // Command name, NULL for an empty slot
+    char *path;  // Resolved path
+    int dir;     // Index of the $PATH directory it was found in
+    int hits;    // Number of times it was looked up
+};
+
+static char *path_value = NULL; // $PATH the tables below were built for
+static struct path_dir *dirs = NULL;
+static int dir_count = 0;
+
+static struct hash_entry *table = NULL;
+static size_t table_size = 0; // Always a power of two
+static size_t table_used = 0;
+
+static uint32_t hash_name(const char *s) {
+    uint32_t h = 2166136261u; // FNV-1a
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int dir_changed(struct path_dir *d) {
+    struct stat st;
+    int exists = stat(d->name[0] ? d->name : ".", &st) == 0;
+
+    if (exists != d->exists) {
+        return 1;
+    }
+    return exists && (st.st_mtim.tv_sec != d->mtime.tv_sec ||
+                      st.st_mtim.tv_nsec != d->mtime.tv_nsec);
+}
+
+static void dir_refresh(struct path_dir *d) {
+    struct stat st;
+
+    d->exists = stat(d->name[0] ? d->name : ".", &st) == 0;
+    if (d->exists) {
+        d->mtime = st.st_mtim;
+    }
+}
+
+static void clear_table(void) {
+    if (table == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < table_size; i++) {
+        free(table[i].name);
+        free(table[i].path);
+    }
+    memset(table, 0, table_size * sizeof(*table));
+    table_used = 0;
+}
+
+static void free_dirs(void) {
+    for (int i = 0; i < dir_count; i++) {
+        free(dirs[i].name);
+    }
+    free(dirs);
+    free(path_value);
+    dirs = NULL;
+    dir_count = 0;
+    path_value = NULL;
+}
+
+// Split $PATH into directories, unless it is the one we already know
+static void load_path(void) {
+    const char *path = getenv("PATH");
+
+    if (path == NULL) {
+        path = "/usr/local/bin:/usr/bin:/bin";
+    }
+    if (path_value != NULL && strcmp(path, path_value) == 0) {
+        return;
+    }
+
+    free_dirs();
+    clear_table();
+    path_value = strdup(path);
+    if (path_value == NULL) {
+        return;
+    }
+
+    int count = 1;
+    for (const char *p = path; *p; p++) {
+        if (*p == ':') {
+            count++;
+        }
+    }
+    dirs = calloc(count, sizeof(*dirs));
+    if (dirs == NULL) {
+        return;
+    }
+
+    const char *start = path;
+    for (;;) {
+        const char *end = strchr(start, ':');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+
+        dirs[dir_count].name = strndup(start, len);
+        if (dirs[dir_count].name == NULL) {
+            break;
+        }
+        dir_refresh(&dirs[dir_count]);
+        dir_count++;
+        if (end == NULL) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+static struct hash_entry *find_slot(const char *name) {
+    size_t mask = table_size - 1;
+    size_t i = hash_name(name) & mask;
+
+    while (table[i].name != NULL && strcmp(table[i].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &table[i];
+}
+
+static int grow_table(void) {
+    size_t old_size = table_size;
+    struct hash_entry *old = table;
+    size_t new_size = old_size ? old_size * 2 : 64;
+
+    table = calloc(new_size, sizeof(*table));
+    if (table == NULL) {
+        table = old;
+        return -1;
+    }
+    table_size = new_size;
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].name != NULL) {
+            *find_slot(old[i].name) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+// Search $PATH for 'name'. Returns a malloc'ed path and stores the index of
+// the directory it was found in, or returns NULL.
+static char *search_path(const char *name, int *dir) {
+    for (int i = 0; i < dir_count; i++) {
+        const char *d = dirs[i].name[0] ? dirs[i].name : ".";
+        size_t len = strlen(d) + strlen(name) + 2;
+        char *candidate = malloc(len);
+        struct stat st;
+
+        if (candidate == NULL) {
+            return NULL;
+        }
+        snprintf(candidate, len, "%s/%s", d, name);
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+            access(candidate, X_OK) == 0) {
+            *dir = i;
+            return candidate;
+        }
+        free(candidate);
+    }
+    return NULL;
+}
+
+static struct hash_entry *resolve(const char *name) {
+    struct hash_entry *e;
+    int dir;
+
+    load_path();
+    if (table_size == 0 && grow_table() == -1) {
+        return NULL;
+    }
+
+    e = find_slot(name);
+    if (e->name != NULL) {
+        // Every directory searched before the hit must be unchanged, or
+        // a new command may now shadow it; the hit's own directory must
+        // be unchanged, or the command may be gone.
+        int stale = 0;
+        for (int i = 0; i <= e->dir && !stale; i++) {
+            stale = dir_changed(&dirs[i]);
+        }
+        if (!stale) {
+            return e;
+        }
+        for (int i = 0; i < dir_count; i++) {
+            dir_refresh(&dirs[i]);
+        }
+        clear_table();
+    }
+
+    char *path = search_path(name, &dir);
+    if (path == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    // Relative $PATH entries depend on the current directory; don't keep them
+    if (dirs[dir].name[0] != '/') {
+        static struct hash_entry uncached;
+        free(uncached.path);
+        uncached.path = path;
+        uncached.dir = dir;
+        return &uncached;
+    }
+
+    if ((table_used + 1) * 4 > table_size * 3 && grow_table() == -1) {
+        free(path);
+        return NULL;
+    }
+    e = find_slot(name);
+    e->name = strdup(name);
+    if (e->name == NULL) {
+        free(path);
+        return NULL;
+    }
+    e->path = path;
+    e->dir = dir;
+    e->hits = 0;
+    table_used++;
+    return e;
+}
+
+const char *path_hash_lookup(const char *name) {
+    struct hash_entry *e;
+
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+    e = resolve(name);
+    if (e == NULL) {
+        return NULL;
+    }
+    e->hits++;
+    return e->path;
+}
+
+int path_hash_add(const char *name) {
+    if (strchr(name, '/') != NULL) {
+        return 0;
+    }
+    return resolve(name) != NULL ? 0 : -1;
+}
+
+void path_hash_reset(void) {
+    clear_table();
+    free_dirs();
+}
+
+void path_hash_print(void) {
+    if (table_used == 0) {
+        printf(NSH_INFO "hash: hash table empty\n" NSH_RESET);
+        fflush(stdout);
+        return;
+    }
+    printf(NSH_ACCENT "hits\tcommand\n" NSH_RESET);
+    for (size_t i = 0; i < table_size; i++) {
+        if (table[i].name != NULL) {
+            printf(NSH_FG "%4d\t%s\n" NSH_RESET, table[i].hits, table[i].path);
+        }
+    }
+    fflush(stdout);
+}
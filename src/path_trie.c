@@ -0,0 +1,321 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#include "libs/path_trie.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define NO_NODE UINT32_MAX
+
+struct trie_dir {
+    char *name;            // Directory as written in $PATH ("" means ".")
+    dev_t dev;             // Identity of the directory when it was read: a
+    ino_t ino;             // relative entry follows the current directory
+    struct timespec mtime; // Modification time when it was read
+    int exists;            // Whether it could be read, -1 before the first time
+    char *names;           // Executables found in it, each NUL-terminated
+    size_t names_len;
+};
+
+struct trie_node {
+    unsigned char c;   // Byte on the edge leading to this node
+    unsigned char end; // Whether a name ends here
+    uint32_t child;    // First child, 0 if none
+    uint32_t next;     // Next sibling, siblings are sorted by byte; 0 if none
+};
+
+// Record returned by getdents64(), which older C libraries do not declare
+struct dirent64_rec {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static char *path_value = NULL; // $PATH the tables below were built for
+static struct trie_dir *dirs = NULL;
+static int dir_count = 0;
+
+static struct trie_node *nodes = NULL; // nodes[0] is the root, 0 nodes means stale
+static uint32_t node_count = 0;
+static uint32_t node_size = 0;
+
+static int dir_changed(struct trie_dir *d) {
+    struct stat st;
+    int exists = stat(d->name[0] ? d->name : ".", &st) == 0;
+
+    if (exists != d->exists) {
+        return 1;
+    }
+    return exists && (st.st_dev != d->dev || st.st_ino != d->ino ||
+                      st.st_mtim.tv_sec != d->mtime.tv_sec ||
+                      st.st_mtim.tv_nsec != d->mtime.tv_nsec);
+}
+
+static int is_executable(int dfd, const char *name, unsigned char type) {
+    struct stat st;
+
+    if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) {
+        return 0;
+    }
+    // Links and entries of file systems without d_type are followed
+    if (type != DT_REG && (fstatat(dfd, name, &st, 0) != 0 || !S_ISREG(st.st_mode))) {
+        return 0;
+    }
+    return faccessat(dfd, name, X_OK, 0) == 0;
+}
+
+// Read the names of the executables in a directory. Its modification time is
+// taken before reading, so a change made while reading is seen next time.
+static void dir_scan(struct trie_dir *d) {
+    uint64_t buf[4096];
+    size_t size = 0;
+    struct stat st;
+    int fd;
+
+    free(d->names);
+    d->names = NULL;
+    d->names_len = 0;
+
+    fd = open(d->name[0] ? d->name : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    d->exists = fd != -1 && fstat(fd, &st) == 0;
+    if (!d->exists) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+    d->dev = st.st_dev;
+    d->ino = st.st_ino;
+    d->mtime = st.st_mtim;
+
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        for (long off = 0; off < n;) {
+            struct dirent64_rec *e = (struct dirent64_rec *)((char *)buf + off);
+            size_t len;
+
+            off += e->d_reclen;
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0 ||
+                !is_executable(fd, e->d_name, e->d_type)) {
+                continue;
+            }
+            len = strlen(e->d_name) + 1;
+            if (d->names_len + len > size) {
+                size_t new_size = size ? size * 2 : 4096;
+                char *names = realloc(d->names, new_size);
+                if (names == NULL) {
+                    continue;
+                }
+                d->names = names;
+                size = new_size;
+            }
+            memcpy(d->names + d->names_len, e->d_name, len);
+            d->names_len += len;
+        }
+    }
+    close(fd);
+}
+
+static void free_dirs(void) {
+    for (int i = 0; i < dir_count; i++) {
+        free(dirs[i].name);
+        free(dirs[i].names);
+    }
+    free(dirs);
+    free(path_value);
+    dirs = NULL;
+    dir_count = 0;
+    path_value = NULL;
+}
+
+// Split the search path into directories, unless it is the one we already
+// know. $PATH is not read here: completion runs on another thread than the
+// shell, which may change the environment at the same time.
+static void load_path(const char *path) {
+    if (path == NULL) {
+        path = "/usr/local/bin:/usr/bin:/bin";
+    }
+    if (path_value != NULL && strcmp(path, path_value) == 0) {
+        return;
+    }
+
+    free_dirs();
+    node_count = 0;
+    path_value = strdup(path);
+    if (path_value == NULL) {
+        return;
+    }
+
+    int count = 1;
+    for (const char *p = path; *p; p++) {
+        if (*p == ':') {
+            count++;
+        }
+    }
+    dirs = calloc(count, sizeof(*dirs));
+    if (dirs == NULL) {
+        return;
+    }
+
+    const char *start = path;
+    for (;;) {
+        const char *end = strchr(start, ':');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+
+        dirs[dir_count].name = strndup(start, len);
+        if (dirs[dir_count].name == NULL) {
+            break;
+        }
+        dirs[dir_count].exists = -1;
+        dir_count++;
+        if (end == NULL) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+// Make room for 'more' nodes, so pointers into the array stay valid while
+// a name is inserted
+static int reserve_nodes(size_t more) {
+    if (node_count + more <= node_size) {
+        return 0;
+    }
+    size_t new_size = node_size ? node_size : 1024;
+    while (new_size < node_count + more) {
+        new_size *= 2;
+    }
+    struct trie_node *n = realloc(nodes, new_size * sizeof(*nodes));
+    if (n == NULL) {
+        return -1;
+    }
+    nodes = n;
+    node_size = new_size;
+    return 0;
+}
+
+static uint32_t find_child(uint32_t n, unsigned char c) {
+    for (n = nodes[n].child; n != 0 && nodes[n].c < c; n = nodes[n].next) {
+    }
+    return n != 0 && nodes[n].c == c ? n : NO_NODE;
+}
+
+static int trie_insert(const char *name) {
+    uint32_t n = 0;
+
+    if (reserve_nodes(strlen(name)) == -1) {
+        return -1;
+    }
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        uint32_t *link = &nodes[n].child;
+
+        while (*link != 0 && nodes[*link].c < *p) {
+            link = &nodes[*link].next;
+        }
+        if (*link == 0 || nodes[*link].c != *p) {
+            nodes[node_count] = (struct trie_node){*p, 0, 0, *link};
+            *link = node_count++;
+        }
+        n = *link;
+    }
+    nodes[n].end = 1;
+    return 0;
+}
+
+static void rebuild(void) {
+    node_count = 0;
+    if (reserve_nodes(1) == -1) {
+        return;
+    }
+    nodes[node_count++] = (struct trie_node){0, 0, 0, 0};
+    for (int i = 0; i < dir_count; i++) {
+        for (size_t off = 0; off < dirs[i].names_len; off += strlen(dirs[i].names + off) + 1) {
+            if (trie_insert(dirs[i].names + off) == -1) {
+                node_count = 0;
+                return;
+            }
+        }
+    }
+}
+
+// Read again the directories that changed since they were last read
+static void refresh(const char *path) {
+    int changed;
+
+    load_path(path);
+    changed = node_count == 0;
+    for (int i = 0; i < dir_count; i++) {
+        if (dir_changed(&dirs[i])) {
+            dir_scan(&dirs[i]);
+            changed = 1;
+        }
+    }
+    if (changed) {
+        rebuild();
+    }
+}
+
+// Report every name below node 'n', whose first 'len' bytes are in 'name'
+static size_t trie_walk(uint32_t n, char *name, size_t len, int hide_dot,
+                        void (*add)(const char *name, void *arg), void *arg) {
+    size_t found = 0;
+
+    if (nodes[n].end) {
+        name[len] = '\0';
+        add(name, arg);
+        found++;
+    }
+    for (uint32_t c = nodes[n].child; c != 0; c = nodes[c].next) {
+        if (hide_dot && nodes[c].c == '.') {
+            continue;
+        }
+        name[len] = (char)nodes[c].c;
+        found += trie_walk(c, name, len + 1, 0, add, arg);
+    }
+    return found;
+}
+
+size_t path_trie_complete(const char *path, const char *prefix,
+                          void (*add)(const char *name, void *arg), void *arg) {
+    char name[NAME_MAX + 1];
+    size_t len = strlen(prefix);
+    uint32_t n = 0;
+
+    refresh(path);
+    if (node_count == 0 || len > NAME_MAX) {
+        return 0;
+    }
+    for (size_t i = 0; i < len && n != NO_NODE; i++) {
+        n = find_child(n, (unsigned char)prefix[i]);
+    }
+    if (n == NO_NODE) {
+        return 0;
+    }
+    memcpy(name, prefix, len);
+    return trie_walk(n, name, len, len == 0, add, arg);
+}
+
+void path_trie_reset(void) {
+    free_dirs();
+    free(nodes);
+    nodes = NULL;
+    node_count = 0;
+    node_size = 0;
+}
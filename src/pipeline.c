@@ -0,0 +1,329 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#define _GNU_SOURCE
+
+#include "libs/pipeline.h"
+#include "libs/builtins.h"
+#include "libs/jobs.h"
+#include "libs/launch.h"
+#include "libs/script.h"
+#include "libs/utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// NSH_PIPESIZE=<bytes> enlarges the pipes between commands, for stages that
+// move a lot of data. The kernel rounds it up to a power of two pages and
+// caps it at /proc/sys/fs/pipe-max-size.
+static int pipe_size(void) {
+    const char *value = getenv("NSH_PIPESIZE");
+    char *end;
+    long size;
+
+    if (value == NULL || *value == '\0') {
+        return 0;
+    }
+    size = strtol(value, &end, 10);
+    if (*end == 'k' || *end == 'K') {
+        size *= 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        size *= 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0' || size <= 0 || size > 1L << 30) {
+        return 0;
+    }
+    return (int)size;
+}
+
+/* The descriptors of one command: its ends of the pipes, then its
+ * redirections, and the files the shell opened for them. */
+struct stage_fds {
+    struct launch_options opts;
+    int files[LAUNCH_MAX_FDS];
+    int file_count;
+};
+
+/* A descriptor of the shell replaced while a builtin runs. */
+struct saved_fd {
+    int fd;
+    int copy; // -1 if 'fd' was not open
+};
+
+static int is_builtin(const struct command *cmd) {
+    return cmd->argc == 0 || builtin_lookup(cmd->argv[0]) != NULL;
+}
+
+// A builtin (or an empty command) alone in the foreground runs inside the
+// shell, so that cd, export or exit act on it; so does a script. In a
+// pipeline or in the background, a builtin runs in a child of its own, like
+// in other shells: `cd / | cat` leaves the shell where it is.
+static int runs_in_shell(const struct command *cmd, int alone) {
+    if (!alone) {
+        return 0;
+    }
+    return is_builtin(cmd) || is_script_file(command_path(cmd->argv[0]));
+}
+
+// Body of the child that runs a builtin of a pipeline
+static int run_builtin_child(void *arg) {
+    struct command *cmd = arg;
+
+    jobs_subshell();
+    return cmd->argc ? execute_command(cmd->argc, cmd->argv) : 0;
+}
+
+static int add_fd(struct launch_options *opts, int from, int to) {
+    if (opts->fd_count == LAUNCH_MAX_FDS) {
+        fprintf(stderr, NSH_ERR "nsh: too many redirections\n" NSH_RESET);
+        return -1;
+    }
+    opts->fds[opts->fd_count].from = from;
+    opts->fds[opts->fd_count++].to = to;
+    return 0;
+}
+
+static void close_files(struct stage_fds *sf) {
+    while (sf->file_count > 0) {
+        close(sf->files[--sf->file_count]);
+    }
+}
+
+// Collect the descriptors of 'cmd': 'in' and 'out' (-1 for none) become its
+// stdin and stdout, then its redirections apply in order. Files are opened
+// here, and only duplicated into place by the child or the builtin.
+static int setup_stage(const struct command *cmd, int in, int out, struct stage_fds *sf) {
+    sf->opts.fd_count = 0;
+    sf->file_count = 0;
+    if ((in != -1 && add_fd(&sf->opts, in, STDIN_FILENO) == -1) ||
+        (out != -1 && add_fd(&sf->opts, out, STDOUT_FILENO) == -1)) {
+        return -1;
+    }
+    for (int i = 0; i < cmd->redirect_count; i++) {
+        const struct redirect *r = &cmd->redirects[i];
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+        int fd;
+
+        if (r->type == REDIRECT_DUP) {
+            if (add_fd(&sf->opts, r->dup_fd, r->fd) == -1) {
+                goto fail;
+            }
+            continue;
+        }
+        if (r->type == REDIRECT_IN) {
+            flags = O_RDONLY | O_CLOEXEC;
+        } else {
+            flags |= (r->type == REDIRECT_APPEND) ? O_APPEND : O_TRUNC;
+        }
+        fd = open(r->path, flags, 0666);
+        // Keep clear of the descriptors 0-9 redirections can name
+        if (fd != -1 && fd < 10) {
+            int high = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+            close(fd);
+            fd = high;
+        }
+        if (fd == -1) {
+            fprintf(stderr, NSH_ERR "nsh: %s: %s\n" NSH_RESET, r->path, strerror(errno));
+            goto fail;
+        }
+        sf->files[sf->file_count++] = fd;
+        if (add_fd(&sf->opts, fd, r->fd) == -1) {
+            goto fail;
+        }
+    }
+    return 0;
+
+fail:
+    close_files(sf);
+    return -1;
+}
+
+static void restore_fds(struct saved_fd *saved, int count) {
+    fflush(stdout);
+    while (count-- > 0) {
+        if (saved[count].copy == -1) {
+            close(saved[count].fd);
+        } else {
+            dup2(saved[count].copy, saved[count].fd);
+            close(saved[count].copy);
+        }
+    }
+}
+
+// Install the descriptors of a builtin in the shell itself, remembering
+// the ones they replace
+static int swap_fds(const struct launch_options *opts, struct saved_fd *saved, int *count) {
+    *count = 0;
+    fflush(stdout);
+    for (int i = 0; i < opts->fd_count; i++) {
+        int to = opts->fds[i].to;
+        int j = 0;
+
+        while (j < *count && saved[j].fd != to) {
+            j++;
+        }
+        if (j == *count) {
+            saved[j].fd = to;
+            saved[j].copy = fcntl(to, F_DUPFD_CLOEXEC, 10);
+            (*count)++;
+        }
+        if (opts->fds[i].from != to && dup2(opts->fds[i].from, to) == -1) {
+            fprintf(stderr, NSH_ERR "nsh: %d: %s\n" NSH_RESET, opts->fds[i].from, strerror(errno));
+            restore_fds(saved, *count);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Run a builtin (or a script) inside the shell, with its descriptors
+// swapped in for the time it runs
+static int run_in_shell(struct command *cmd, const struct launch_options *opts) {
+    struct sigaction ignore = {.sa_handler = SIG_IGN}, saved_pipe;
+    struct saved_fd saved[LAUNCH_MAX_FDS];
+    int count;
+    int status = 0;
+
+    if (opts->fd_count == 0) {
+        return cmd->argc ? execute_command(cmd->argc, cmd->argv) : 0;
+    }
+    if (swap_fds(opts, saved, &count) == -1) {
+        return 1;
+    }
+    // A reader that exits early must not kill the shell: writes fail instead
+    sigaction(SIGPIPE, &ignore, &saved_pipe);
+    if (cmd->argc > 0) {
+        status = execute_command(cmd->argc, cmd->argv);
+    }
+    fflush(stdout);
+    clearerr(stdout);
+    restore_fds(saved, count);
+    sigaction(SIGPIPE, &saved_pipe, NULL);
+    return status;
+}
+
+static int run_stages(struct pipeline *pl) {
+    int n = pl->count;
+    int pipes[n > 1 ? n - 1 : 1][2];
+    pid_t pids[n]; // 0: runs in the shell, -1: could not be started
+    int statuses[n];
+    struct stage_fds sf;
+    struct job *job = job_create(pl->line, n);
+    int size = pipe_size();
+
+    if (job == NULL) {
+        fprintf(stderr, NSH_ERR "nsh: out of memory\n" NSH_RESET);
+        return 1;
+    }
+
+    // Every pipe exists before the first command starts
+    for (int i = 0; i < n - 1; i++) {
+        if (pipe2(pipes[i], O_CLOEXEC) == -1) {
+            perror(NSH_ERR "pipe" NSH_RESET);
+            while (i-- > 0) {
+                close(pipes[i][0]);
+                close(pipes[i][1]);
+            }
+            job_free(job);
+            return 1;
+        }
+        if (size > 0) {
+            // Best effort: a refused size leaves the default 64 KiB
+            fcntl(pipes[i][1], F_SETPIPE_SZ, size);
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        struct command *cmd = &pl->commands[i];
+
+        pids[i] = 0;
+        statuses[i] = 0;
+        if (runs_in_shell(cmd, n == 1 && !pl->background)) {
+            continue;
+        }
+        if (setup_stage(cmd, i > 0 ? pipes[i - 1][0] : -1, i < n - 1 ? pipes[i][1] : -1, &sf) == -1) {
+            pids[i] = -1;
+            statuses[i] = 1;
+            continue;
+        }
+        // The first command starts the process group, the others join it
+        sf.opts.pgid = job->pgid;
+        sf.opts.foreground = job->pgid == 0 && !pl->background;
+        if (is_builtin(cmd)) {
+            pids[i] = launch_function(run_builtin_child, cmd, &sf.opts);
+        } else {
+            pids[i] = launch_command(cmd->argv, &sf.opts);
+        }
+        if (pids[i] < 0) {
+            perror(cmd->argc ? cmd->argv[0] : "nsh");
+            statuses[i] = 127;
+        } else {
+            job_add_process(job, pids[i]);
+        }
+        close_files(&sf);
+    }
+
+    // Every stage of a pipeline is a child: the shell keeps no pipe end
+    for (int i = 0; i < n - 1; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    // A builtin or script alone, with redirections
+    if (pids[0] == 0 && n == 1) {
+        sf.opts.pgid = -1;
+        sf.opts.foreground = 0;
+        if (setup_stage(&pl->commands[0], -1, -1, &sf) == -1) {
+            statuses[0] = 1;
+        } else {
+            statuses[0] = run_in_shell(&pl->commands[0], &sf.opts);
+            close_files(&sf);
+        }
+    }
+
+    if (job->count == 0) {
+        job_free(job);
+    } else if (pl->background) {
+        job_background(job);
+        return 0;
+    } else {
+        int status = job_foreground(job);
+        // A stopped job stops the whole pipeline
+        if (pids[n - 1] > 0 || status == 128 + SIGTSTP) {
+            statuses[n - 1] = status;
+        }
+    }
+    return statuses[n - 1];
+}
+
+int run_pipeline(struct pipeline *pl) {
+    int status;
+
+    // Builtins and scripts on their own need no job
+    if (pl->count == 1 && pl->commands[0].redirect_count == 0 && !pl->background &&
+        runs_in_shell(&pl->commands[0], 1)) {
+        return execute_command(pl->commands[0].argc, pl->commands[0].argv);
+    }
+
+    if (color_output()) {
+        printf(NSH_RESET);
+        fflush(stdout);
+    }
+    status = run_stages(pl);
+    if (color_output()) {
+        printf(NSH_RESET);
+        fflush(stdout);
+    }
+    set_last_exit_status(status);
+    return status;
+}
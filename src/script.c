@@ -0,0 +1,377 @@
+/*
+ * NovaShell - GPLv3
+ * Copyright (C) 2026 Evloni
+ *
+ * This file is part of NovaShell.
+ * See LICENSE in the project root for full license information.
+ */
+
+#include "libs/script.h"
+#include "libs/builtins.h"
+#include "libs/launch.h"
+#include "libs/parser.h"
+#include "libs/pipeline.h"
+#include "libs/utils.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern char **environ;
+
+struct script_frame {
+    const char *name; // $0
+    char **args;      // $1..$N
+    int argc;
+    int exit_requested;
+    int exit_status;
+    struct script_frame *parent;
+};
+
+static struct script_frame *current = NULL;
+
+// Shell keywords and bash builtins nsh has no equivalent for. A script
+// using any of them as a command is handed to bash.
+static const char *unsupported_commands[] = {
+    "if", "then", "else", "elif", "fi", "for", "while", "until", "do",
+    "done", "case", "esac", "function", "select", "{", "}", "[[", "]]",
+    "!", "source", ".", "set", "shift", "read", "local", "return", "trap",
+    "eval", "exec", "unset", "alias", "declare", "typeset", "readonly",
+    "let", "getopts", "break", "continue", "ulimit", "umask", NULL};
+
+int script_running(void) {
+    return current != NULL;
+}
+
+void script_exit(int status) {
+    if (current != NULL) {
+        current->exit_requested = 1;
+        current->exit_status = status;
+    }
+}
+
+const char *script_arg(int n) {
+    if (n == 0) {
+        return current ? current->name : "nsh";
+    }
+    if (current == NULL || n > current->argc) {
+        return "";
+    }
+    return current->args[n - 1];
+}
+
+int script_arg_count(void) {
+    return current ? current->argc : 0;
+}
+
+// Read the whole file into a NUL-terminated buffer
+static char *read_file(const char *path) {
+    struct stat st;
+    char *data;
+    ssize_t n;
+    size_t len = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+        (data = malloc(st.st_size + 1)) == NULL) {
+        close(fd);
+        return NULL;
+    }
+    while (len < (size_t)st.st_size && (n = read(fd, data + len, st.st_size - len)) > 0) {
+        len += n;
+    }
+    close(fd);
+    data[len] = '\0';
+    return data;
+}
+
+// Look at the #! line. Returns 1 if the script is meant for a POSIX-ish
+// shell (or has no #! line at all), 0 for any other interpreter.
+static int is_shell_script(const char *data) {
+    char interp[256];
+    const char *name;
+
+    if (strncmp(data, "#!", 2) != 0) {
+        return 1;
+    }
+    // "#!/bin/bash -e" -> "/bin/bash", "#!/usr/bin/env nsh" -> "nsh"
+    if (sscanf(data + 2, " %255s", interp) != 1) {
+        return 1;
+    }
+    name = strrchr(interp, '/') ? strrchr(interp, '/') + 1 : interp;
+    if (strcmp(name, "env") == 0) {
+        const char *arg = data + 2;
+        while (*arg == ' ' || *arg == '\t') {
+            arg++;
+        }
+        arg += strlen(interp);
+        if (sscanf(arg, " %255s", interp) != 1) {
+            return 0;
+        }
+        name = interp;
+    }
+    return strcmp(name, "sh") == 0 || strcmp(name, "bash") == 0 ||
+           strcmp(name, "dash") == 0 || strcmp(name, "nsh") == 0;
+}
+
+static int is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_';
+}
+
+static int is_assignment(const char *word) {
+    if (!((*word >= 'a' && *word <= 'z') || (*word >= 'A' && *word <= 'Z') || *word == '_')) {
+        return 0;
+    }
+    while (*word && *word != '=') {
+        if (!((*word >= 'a' && *word <= 'z') || (*word >= 'A' && *word <= 'Z') ||
+              (*word >= '0' && *word <= '9') || *word == '_')) {
+            return 0;
+        }
+        word++;
+    }
+    return *word == '=';
+}
+
+// Look for the expansions the parser leaves to bash: pathname expansion
+// (an unquoted '*', '?' or '['), tilde expansion at the start of a word or
+// after a '=', and an unquoted parameter expansion, which bash splits into
+// several words. $#, $? and $! always expand to one number and are kept.
+static int needs_expansion(const char *line) {
+    int word_start = 1;
+
+    for (const char *p = line; *p; p++) {
+        char c = *p;
+
+        if (c == '#' && word_start) {
+            return 0;
+        }
+        if (c == '\\') {
+            if (*++p == '\0') {
+                return 0;
+            }
+        } else if (c == '\'') {
+            p = strchr(p + 1, '\'');
+            if (p == NULL) {
+                return 0; // The parser reports it
+            }
+        } else if (c == '"') {
+            // Inside double quotes nothing is split or globbed
+            while (*++p && *p != '"') {
+                if (*p == '\\' && p[1]) {
+                    p++;
+                }
+            }
+            if (*p == '\0') {
+                return 0;
+            }
+        } else if (c == '*' || c == '?' || c == '[' ||
+                   (c == '~' && (word_start || p[-1] == '='))) {
+            return 1;
+        } else if (c == '$' && p[1] && strchr("#?!", p[1]) != NULL) {
+            p++;
+        } else if (c == '$' && (p[1] == '{' || p[1] == '@' || p[1] == '*' || is_name_char(p[1]))) {
+            return 1;
+        }
+        word_start = strchr(" \t|<>&", c) != NULL;
+    }
+    return 0;
+}
+
+// Check that every line of the script is something nsh can run itself
+static int script_supported(char *data) {
+    char *line = data;
+
+    while (line != NULL) {
+        char *next = strchr(line, '\n');
+        struct pipeline pl = {0};
+        int count = 0;
+
+        if (next) {
+            *next = '\0';
+        }
+        int supported = !needs_expansion(line);
+        if (supported) {
+            count = parse_pipeline(line, &pl);
+            supported = count >= 0;
+        }
+        if (next) {
+            *next = '\n';
+        }
+
+        for (int c = 0; c < count; c++) {
+            char **argv = pl.commands[c].argv;
+
+            if (argv[0] == NULL || builtin_lookup(argv[0]) != NULL) {
+                continue;
+            }
+            for (int i = 0; unsupported_commands[i] != NULL; i++) {
+                if (strcmp(argv[0], unsupported_commands[i]) == 0) {
+                    supported = 0;
+                }
+            }
+            if (is_assignment(argv[0])) {
+                supported = 0;
+            }
+        }
+        free_pipeline(&pl);
+        if (!supported) {
+            return 0;
+        }
+        line = next ? next + 1 : NULL;
+    }
+    return 1;
+}
+
+// Snapshot of the environment, so a script cannot change the shell's one
+static char **save_environment(void) {
+    size_t count = 0;
+    char **saved;
+
+    while (environ[count] != NULL) {
+        count++;
+    }
+    saved = malloc((count + 1) * sizeof(char *));
+    if (saved == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        saved[i] = strdup(environ[i]);
+    }
+    saved[count] = NULL;
+    return saved;
+}
+
+// Strings of the environment restored last. putenv() keeps them in environ,
+// so they are only freed once the next restore has cleared it.
+static char **restored = NULL;
+
+static void restore_environment(char **saved) {
+    size_t kept = 0;
+
+    clearenv();
+    for (size_t i = 0; saved[i] != NULL; i++) {
+        if (putenv(saved[i]) == 0) {
+            saved[kept++] = saved[i];
+        } else {
+            free(saved[i]);
+        }
+    }
+    saved[kept] = NULL;
+    if (restored != NULL) {
+        for (size_t i = 0; restored[i] != NULL; i++) {
+            free(restored[i]);
+        }
+        free(restored);
+    }
+    restored = saved;
+}
+
+static int run_lines(char *data) {
+    char *line = data;
+    int status = 0;
+
+    while (line != NULL && !current->exit_requested) {
+        char *next = strchr(line, '\n');
+        struct pipeline pl;
+
+        if (next) {
+            *next = '\0';
+        }
+        int count = parse_pipeline(line, &pl);
+        if (count < 0) {
+            fprintf(stderr, NSH_ERR "%s: %s\n" NSH_RESET, current->name, pl.error);
+            status = 2;
+        } else if (count > 0) {
+            status = run_pipeline(&pl);
+        }
+        free_pipeline(&pl);
+        // Ctrl-C stops the whole script, not only the command it was running
+        if (status == 128 + SIGINT) {
+            break;
+        }
+        line = next ? next + 1 : NULL;
+    }
+    return current->exit_requested ? current->exit_status : status;
+}
+
+// Run a script for a foreign interpreter straight through its #! line
+static int run_directly(const char *path, char **args) {
+    int arg_count = 0;
+    while (args && args[arg_count]) {
+        arg_count++;
+    }
+
+    char *argv[arg_count + 2];
+    char local_path[PATH_MAX];
+    argv[0] = (char *)path;
+    for (int i = 0; i < arg_count; i++) {
+        argv[i + 1] = args[i];
+    }
+    argv[arg_count + 1] = NULL;
+
+    // A bare file name means the file in the current directory, not $PATH
+    if (strchr(path, '/') == NULL) {
+        snprintf(local_path, sizeof(local_path), "./%s", path);
+        path = local_path;
+    }
+    pid_t pid = launch_process(path, argv, NULL);
+    if (pid < 0) {
+        perror(argv[0]);
+        return 126;
+    }
+    return wait_process(pid);
+}
+
+int script_run(const char *path, char **args) {
+    struct script_frame frame = {0};
+    char *data = read_file(path);
+    int status;
+
+    if (data == NULL) {
+        return SCRIPT_FALLBACK; // Let bash report what is wrong
+    }
+    if (!is_shell_script(data)) {
+        free(data);
+        return run_directly(path, args);
+    }
+
+    frame.name = path;
+    frame.args = args;
+    while (args && args[frame.argc]) {
+        frame.argc++;
+    }
+    frame.parent = current;
+    current = &frame;
+
+    if (!script_supported(data)) {
+        current = frame.parent;
+        free(data);
+        return SCRIPT_FALLBACK;
+    }
+
+    // Run like a subshell: undo directory and environment changes after
+    int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    char **env = save_environment();
+
+    status = run_lines(data);
+
+    if (env != NULL) {
+        restore_environment(env);
+    }
+    if (cwd != -1) {
+        if (fchdir(cwd) == -1) {
+            perror(NSH_ERR "cd" NSH_RESET);
+        }
+        close(cwd);
+    }
+    current = frame.parent;
+    free(data);
+    return status;
+}
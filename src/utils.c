@@ -7,10 +7,20 @@
  */
 
 #include "libs/utils.h"
+#include "libs/builtins.h"
+#include "libs/launch.h"
+#include "libs/path_hash.h"
+#include "libs/path_trie.h"
+#include "libs/script.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
 void banner(void) {
@@ -22,107 +32,363 @@ void banner(void) {
     printf("\n");
 }
 
-void completion(const char *buff, linenoiseCompletions *lc) {
-    const char *commands[] = {"exit", "cd", "echo", "export", "clear", "help", "pwd", "dir"};
-    int numCommands = sizeof(commands) / sizeof(commands[0]);
+// Offer the line up to 'len' followed by 'word' as a completion
+static void add_completion(linenoiseCompletions *lc, const char *line, size_t len, const char *word) {
+    size_t word_len = strlen(word);
+    char *s = malloc(len + word_len + 1);
+
+    if (s == NULL) {
+        return;
+    }
+    memcpy(s, line, len);
+    memcpy(s + len, word, word_len + 1);
+    linenoiseAddCompletion(lc, s);
+    free(s);
+}
+
+struct command_completion {
+    linenoiseCompletions *lc;
+    const char *line;
+    size_t len;
+};
+
+// Called by path_trie_complete(); builtins were offered already
+static void add_command(const char *name, void *arg) {
+    struct command_completion *c = arg;
+
+    if (builtin_lookup(name) == NULL) {
+        add_completion(c->lc, c->line, c->len, name);
+    }
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Complete 'word', the last word of 'buff', as a file path. Directories get a
+// trailing '/'. With 'commands' set only directories and executables match.
+static void complete_file(const char *buff, const char *word, int commands, linenoiseCompletions *lc) {
+    const char *slash = strrchr(word, '/');
+    const char *base = slash ? slash + 1 : word;
+    size_t base_len = strlen(base);
+    char **names = NULL;
+    size_t count = 0, size = 0;
+    struct dirent *e;
+    char *path;
+    DIR *dir;
 
+    if (slash == NULL) {
+        path = strdup(".");
+    } else {
+        path = strndup(word, slash == word ? 1 : (size_t)(slash - word));
+    }
+    dir = path ? opendir(path) : NULL;
+    free(path);
+    if (dir == NULL) {
+        return;
+    }
+
+    while ((e = readdir(dir)) != NULL && !linenoiseCompletionCancelled(lc)) {
+        struct stat st;
+        int is_dir;
+
+        // Hidden entries only when asked for, and never "." or ".."
+        if ((e->d_name[0] == '.' && base[0] != '.') || strcmp(e->d_name, ".") == 0 ||
+            strcmp(e->d_name, "..") == 0 || strncmp(e->d_name, base, base_len) != 0) {
+            continue;
+        }
+        is_dir = e->d_type == DT_DIR;
+        if (e->d_type == DT_LNK || e->d_type == DT_UNKNOWN) {
+            is_dir = fstatat(dirfd(dir), e->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (commands && !is_dir && faccessat(dirfd(dir), e->d_name, X_OK, 0) != 0) {
+            continue;
+        }
+
+        if (count == size) {
+            size_t new_size = size ? size * 2 : 16;
+            char **n = realloc(names, new_size * sizeof(*names));
+            if (n == NULL) {
+                break;
+            }
+            names = n;
+            size = new_size;
+        }
+        size_t len = strlen(e->d_name);
+        names[count] = malloc(len + 2);
+        if (names[count] == NULL) {
+            break;
+        }
+        memcpy(names[count], e->d_name, len);
+        strcpy(names[count] + len, is_dir ? "/" : "");
+        count++;
+    }
+    closedir(dir);
+
+    if (count > 1) {
+        qsort(names, count, sizeof(*names), compare_names);
+    }
+    for (size_t i = 0; i < count; i++) {
+        add_completion(lc, buff, (size_t)(base - buff), names[i]);
+        free(names[i]);
+    }
+    free(names);
+}
+
+static pthread_mutex_t completion_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *completion_path = NULL; // $PATH when the prompt was shown
+static int completion_forget = 0;    // Drop the executables read so far
+
+// Copy $PATH for the completions of the next prompt. Called by the shell
+// before it shows one, as completion() runs on the completion thread and
+// must not read the environment the shell may change.
+void completion_prepare(void) {
+    const char *path = getenv("PATH");
+    char *copy = path ? strdup(path) : NULL;
+
+    pthread_mutex_lock(&completion_lock);
+    free(completion_path);
+    completion_path = copy;
+    pthread_mutex_unlock(&completion_lock);
+}
+
+// Forget the executables read from $PATH, as `hash -r` does for command
+// lookups. They belong to the completion thread, which drops them before
+// its next completion.
+void completion_reset(void) {
+    pthread_mutex_lock(&completion_lock);
+    completion_forget = 1;
+    pthread_mutex_unlock(&completion_lock);
+}
+
+// The first word completes to builtins and to executables on $PATH, the
+// other words and paths to files. This runs on the completion thread of the
+// line editor, at the same time as the shell itself.
+void completion(const char *buff, linenoiseCompletions *lc) {
     const char *p = buff;
     while (*p == ' ') {
         p++;
     }
 
-    const char *space = strchr(p, ' ');
-    if (space == NULL) {
-        for (int i = 0; i < numCommands; i++) {
-            if (strncmp(p, commands[i], strlen(p)) == 0) {
-                linenoiseAddCompletion(lc, commands[i]);
-            }
+    const char *word = strrchr(p, ' ');
+    word = word ? word + 1 : p;
+    if (word != p || strchr(word, '/') != NULL) {
+        complete_file(buff, word, word == p, lc);
+        return;
+    }
+
+    size_t count;
+    const struct builtin *builtins = builtin_table(&count);
+    size_t len = strlen(word);
+
+    for (size_t i = 0; i < count; i++) {
+        if (strncmp(word, builtins[i].name, len) == 0) {
+            add_completion(lc, buff, (size_t)(word - buff), builtins[i].name);
         }
     }
-}
 
-// Parse command line into tokens (command + arguments)
-// Returns number of tokens, or -1 on error
-int parse_command(char *line, char **argv, int max_args) {
-    int argc = 0;
-    char *token;
-    char *saveptr;
+    // The copy made by completion_prepare(): the environment is not read here
+    pthread_mutex_lock(&completion_lock);
+    char *path = completion_path ? strdup(completion_path) : NULL;
+    int forget = completion_forget;
+    completion_forget = 0;
+    pthread_mutex_unlock(&completion_lock);
 
-    // Skip leading whitespace
-    while (*line == ' ' || *line == '\t') {
-        line++;
+    if (forget) {
+        path_trie_reset();
     }
 
-    // If empty line, return 0
-    if (*line == '\0') {
+    struct command_completion c = {lc, buff, (size_t)(word - buff)};
+    path_trie_complete(path, word, add_command, &c);
+    free(path);
+}
+
+static int status_of_last = 0;
+
+int last_exit_status(void) {
+    return status_of_last;
+}
+
+void set_last_exit_status(int status) {
+    status_of_last = status;
+}
+
+// Colors only make sense on a terminal, not in a pipe or a script
+int color_output(void) {
+    return !script_running() && isatty(STDOUT_FILENO);
+}
+
+/* Results of is_script_file(), keyed on the identity of the file and
+ * invalidated when its modification time or size changes, so a command run
+ * over and over is opened only once. */
+#define SCRIPT_CACHE_SIZE 64
+
+struct script_cache_entry {
+    int valid;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    int is_script;
+};
+
+static struct script_cache_entry script_cache[SCRIPT_CACHE_SIZE];
+
+// Whether 'path' should be run as a script: it has a .sh extension, or it
+// is an existing file starting with a #! line
+int is_script_file(const char *path) {
+    struct stat st;
+    char *ext = strrchr(path, '.');
+
+    if (ext && strcmp(ext, ".sh") == 0) {
+        return 1;
+    }
+    if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
         return 0;
     }
 
-    // Tokenize the line
-    token = strtok_r(line, " \t", &saveptr);
-    while (token != NULL && argc < max_args - 1) {
-        argv[argc++] = token;
-        token = strtok_r(NULL, " \t", &saveptr);
+    struct script_cache_entry *e = &script_cache[(st.st_dev * 31 + st.st_ino) % SCRIPT_CACHE_SIZE];
+    if (e->valid && e->dev == st.st_dev && e->ino == st.st_ino && e->size == st.st_size &&
+        e->mtime.tv_sec == st.st_mtim.tv_sec && e->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        return e->is_script;
     }
-    argv[argc] = NULL; // Null-terminate the array
 
-    return argc;
+    // Check for shebang
+    char first[2];
+    int is_script = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        is_script = read(fd, first, sizeof(first)) == 2 && first[0] == '#' && first[1] == '!';
+        close(fd);
+    }
+
+    e->valid = 1;
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->mtime = st.st_mtim;
+    e->size = st.st_size;
+    e->is_script = is_script;
+    return is_script;
 }
-// Execute external program
-void execute_external(char **argv) {
-    pid_t pid = fork();
 
-    if (pid == 0) {
-        // Child process: execute the command
-        execvp(argv[0], argv);
-        // If execvp returns, there was an error
+// The file a command runs: what $PATH has for a name without a slash, or
+// the name itself
+const char *command_path(const char *name) {
+    const char *path;
+
+    if (strchr(name, '/') == NULL && (path = path_hash_lookup(name)) != NULL) {
+        return path;
+    }
+    return name;
+}
+
+static int run_program(const char *path, char **argv) {
+    pid_t pid = launch_process(path, argv, NULL);
+
+    if (pid < 0) {
         perror(argv[0]);
-        exit(EXIT_FAILURE);
-    } else if (pid < 0) {
-        // Fork failed
-        perror("fork");
+        return 127;
+    }
+    return wait_process(pid);
+}
+
+// Run a parsed command line: a builtin, a script or an external program.
+// Returns the exit status of the command.
+int execute_command(int argc, char **argv) {
+    const struct builtin *builtin = builtin_lookup(argv[0]);
+    int status;
+
+    if (builtin != NULL) {
+        status_of_last = builtin->fn(argc, argv);
+        return status_of_last;
+    }
+
+    if (color_output()) {
+        printf(NSH_RESET);
+        fflush(stdout);
+    }
+
+    // The script check is cached, so a program run over and over is only
+    // opened the first time
+    const char *path = command_path(argv[0]);
+    if (is_script_file(path)) {
+        char **script_args = (argc > 1) ? &argv[1] : NULL;
+        status = execute_script(path, script_args);
+        if (status != 0 && !script_running()) {
+            fprintf(stderr, NSH_ERR "Script exited with status: %d\n" NSH_RESET, status);
+        }
     } else {
-        // Parent process: wait for child to complete
-        int status;
-        waitpid(pid, &status, 0);
+        status = run_program(path, argv);
     }
+    // Reset again after external app in case it changed colors
+    if (color_output()) {
+        printf(NSH_RESET);
+        fflush(stdout);
+    }
+    status_of_last = status;
+    return status;
 }
 
-// Execute scripts with bash
-int execute_script(const char *script_path, char **args) {
-    pid_t pid = fork();
+// Start a command that does not run inside the shell. A script is run
+// natively by another nsh, since this one is busy with something else.
+pid_t launch_command(char **argv, const struct launch_options *opts) {
+    const char *path = command_path(argv[0]);
 
-    if (pid == 0) {
-        int arg_count = 0;
-        if (args) {
-            while (args[arg_count]) {
-                arg_count++;
-            }
+    if (is_script_file(path)) {
+        int argc = 0;
+        while (argv[argc] != NULL) {
+            argc++;
         }
 
-        char *bash_args[arg_count + 3];
-        bash_args[0] = "bash";
-        bash_args[1] = (char *)script_path;
+        char *script_argv[argc + 2];
+        script_argv[0] = "nsh";
+        script_argv[1] = (char *)path;
+        memcpy(script_argv + 2, argv + 1, argc * sizeof(char *));
+        return launch_process("/proc/self/exe", script_argv, opts);
+    }
+    return launch_process(path, argv, opts);
+}
 
-        for (int i = 0; i < arg_count; i++) {
-            bash_args[i + 2] = args[i];
+// Execute external program
+int execute_external(char **argv) {
+    const char *path = path_hash_lookup(argv[0]);
+    if (path == NULL) {
+        perror(argv[0]);
+        return 127;
+    }
+    return run_program(path, argv);
+}
+
+// Execute scripts natively, or with bash if they need a real shell
+int execute_script(const char *script_path, char **args) {
+    int status = script_run(script_path, args);
+    if (status != SCRIPT_FALLBACK) {
+        return status;
+    }
+
+    int arg_count = 0;
+    if (args) {
+        while (args[arg_count]) {
+            arg_count++;
         }
-        bash_args[arg_count + 2] = NULL;
+    }
+
+    char *bash_args[arg_count + 3];
+    bash_args[0] = "bash";
+    bash_args[1] = (char *)script_path;
 
-        execvp("bash", bash_args);
-        // If execvp fails
-        execv("/bin/bash", bash_args);
+    for (int i = 0; i < arg_count; i++) {
+        bash_args[i + 2] = args[i];
+    }
+    bash_args[arg_count + 2] = NULL;
+
+    pid_t pid = launch_process("bash", bash_args, NULL);
+    if (pid < 0 && errno == ENOENT) {
+        pid = launch_process("/bin/bash", bash_args, NULL);
+    }
+    if (pid < 0) {
         perror("exec failed");
-        exit(EXIT_FAILURE);
-    } else if (pid < 0) {
-        perror("fork");
         return -1;
-    } else {
-        int status;
-        waitpid(pid, &status, 0);
-        if (WIFEXITED(status)) {
-            return WEXITSTATUS(status);
-        }
     }
-    return -1;
+    return wait_process(pid);
 }
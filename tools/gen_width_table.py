@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+#
+# NovaShell - GPLv3
+# Copyright (C) 2026 Evloni
+#
+# This file is part of NovaShell.
+# See LICENSE in the project root for full license information.
+
+"""Generate src/libs/linenoise_width.h, the display width table of linenoise.
+
+Every codepoint gets a 2 bit class:
+  0  no width: controls, format characters (ZWJ, ZWSP, ...), Hangul
+     medial vowels and final consonants
+  1  one column
+  2  two columns: East Asian Wide and Fullwidth, which since Unicode 9
+     include the emoji shown as emoji by default
+  3  no width, and part of the character before it: combining marks,
+     variation selectors, emoji skin tone modifiers
+
+The table has two stages: the high bits of a codepoint select a block of
+256 codepoints, the blocks that are the same are stored once.
+
+Usage: tools/gen_width_table.py > src/libs/linenoise_width.h
+"""
+
+import sys
+import unicodedata
+
+BLOCK = 256
+
+
+def width_class(cp):
+    if cp < 0x20 or 0x7F <= cp < 0xA0:
+        return 0
+    if 0x1F3FB <= cp <= 0x1F3FF:  # Skin tone modifiers
+        return 3
+    cat = unicodedata.category(chr(cp))
+    if cat in ("Mn", "Me"):
+        return 3
+    if cat == "Cf" and cp != 0x00AD:  # The soft hyphen is shown
+        return 0
+    if 0x1160 <= cp <= 0x11FF or 0xD7B0 <= cp <= 0xD7FF:
+        return 0
+    if unicodedata.east_asian_width(chr(cp)) in ("W", "F"):
+        return 2
+    # Unassigned codepoints of the CJK planes are Wide by default
+    if cat == "Cn" and (0x20000 <= cp <= 0x2FFFD or 0x30000 <= cp <= 0x3FFFD):
+        return 2
+    return 1
+
+
+def main():
+    blocks, index = [], []
+    seen = {}
+
+    for base in range(0, 0x110000, BLOCK):
+        packed = bytearray(BLOCK // 4)
+        for cp in range(base, base + BLOCK):
+            packed[(cp - base) // 4] |= width_class(cp) << ((cp % 4) * 2)
+        key = bytes(packed)
+        if key not in seen:
+            seen[key] = len(blocks)
+            blocks.append(key)
+        index.append(seen[key])
+    assert len(blocks) <= 256
+
+    out = sys.stdout
+    out.write("/* Generated by tools/gen_width_table.py from Unicode %s. Do not edit.\n"
+              " *\n"
+              " * Display width class of every codepoint, 2 bits each: 0 no width,\n"
+              " * 1 one column, 2 two columns, 3 no width and joined to the character\n"
+              " * before it. See utf8WidthClass() in linenoise.c. */\n\n" % unicodedata.unidata_version)
+    out.write("#ifndef LINENOISE_WIDTH_H\n#define LINENOISE_WIDTH_H\n\n")
+    out.write("#include <stdint.h>\n\n")
+    out.write("/* Block of each run of %d codepoints. */\n" % BLOCK)
+    out.write("static const uint8_t linenoiseWidthIndex[%d] = {\n" % len(index))
+    for i in range(0, len(index), 16):
+        out.write("    " + ", ".join("%d" % b for b in index[i:i + 16]) + ",\n")
+    out.write("};\n\n")
+    out.write("/* The distinct blocks, 4 codepoints per byte. */\n")
+    out.write("static const uint8_t linenoiseWidthBlocks[%d][%d] = {\n" % (len(blocks), BLOCK // 4))
+    for block in blocks:
+        out.write("    {")
+        for i in range(0, len(block), 16):
+            out.write(("" if i == 0 else "\n     ") +
+                      ", ".join("0x%02x" % b for b in block[i:i + 16]) + ",")
+        out.write("},\n")
+    out.write("};\n\n")
+    out.write("#endif\n")
+
+
+if __name__ == "__main__":
+    main()